@@ -0,0 +1,409 @@
+/*******************************************************************************************************
+ DkSkewBenchmark.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkSkewBenchmark.h"
+#include "DkSkewEstimator.h"
+#include "DkTransformStack.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QStringList>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+#include <QtCore/qmath.h>
+
+#include <algorithm>
+
+#include "opencv2/core/core.hpp"
+
+#define DK_SKEW_GT_FILE "skew-gt.csv"		// <file name>;<angle> per line
+
+namespace nmp {
+
+/*-----------------------------------DkSkewSample ---------------------------------------------*/
+
+DkSkewSample::DkSkewSample(const QString& name, const QImage& img, double skewGt) {
+
+	this->name = name;
+	this->img = img;
+	this->skewGt = skewGt;
+}
+
+/*-----------------------------------DkSkewBenchmark ---------------------------------------------*/
+
+/**
+* Evaluates and measures the skew estimation.
+* @param path directory with the pages or a ground truth file (see loadSamples) - synthetic pages are used if it is empty
+* @param maxPages the maximal number of pages that are evaluated
+* @return false if no pages were found
+**/
+bool DkSkewBenchmark::run(const QString& path, int maxPages) {
+
+	QVector<DkSkewSample> samples = loadSamples(path, maxPages);
+
+	if (samples.isEmpty()) {
+		qWarning() << "[Skew Benchmark] no pages found in" << path;
+		return false;
+	}
+
+	// accuracy & stage timings (default settings)
+	QVector<double> errors;
+	QVector<double> stageSum(DkSkewEstimator::stage_end, 0.0);
+	QVector<double> diffs;
+	double coarseMs = 0;
+	double fullMs = 0;
+
+	for (int idx = 0; idx < samples.size(); idx++) {
+
+		const DkSkewSample& s = samples[idx];
+		QVector<double> times;
+		double ms = 0;
+
+		double angle = estimate(s.img, true, times, ms);
+		coarseMs += ms;
+
+		for (int sIdx = 0; sIdx < times.size() && sIdx < stageSum.size(); sIdx++)
+			stageSum[sIdx] += times[sIdx];
+
+		errors << qAbs(angle - s.skewGt);
+
+		// the full resolution run is the reference for the coarse-to-fine search
+		double fullAngle = estimate(s.img, false, times, ms);
+		fullMs += ms;
+		diffs << qAbs(angle - fullAngle);
+
+		qDebug().nospace() << "[Skew Benchmark] " << s.name << " " << s.img.width() << "x" << s.img.height()
+			<< " gt: " << s.skewGt << " estimated: " << angle << " full resolution: " << fullAngle << " error: " << errors.last();
+	}
+
+	reportErrors(errors);
+
+	QStringList stageNames;
+	stageNames << "separability" << "edge map" << "hough" << "weights" << "saliency";
+
+	for (int sIdx = 0; sIdx < stageSum.size() && sIdx < stageNames.size(); sIdx++)
+		qDebug().nospace() << "[Skew Benchmark] " << stageNames[sIdx] << ": " << stageSum[sIdx] / samples.size() << " ms/page";
+
+	std::sort(diffs.begin(), diffs.end());
+	qDebug().nospace() << "[Skew Benchmark] coarse-to-fine: " << coarseMs / samples.size() << " ms/page, full resolution: " 
+		<< fullMs / samples.size() << " ms/page, speedup: " << (coarseMs > 0 ? fullMs / coarseMs : 0.0) 
+		<< " angle difference median: " << percentile(diffs, 0.5) << " max: " << diffs.last();
+
+	// throughput
+	QVector<int> threads;
+	for (int n = 1; n < QThread::idealThreadCount(); n *= 2)
+		threads << n;
+	threads << qMax(QThread::idealThreadCount(), 1);
+
+	int defaultThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+	for (int tIdx = 0; tIdx < threads.size(); tIdx++)
+		qDebug().nospace() << "[Skew Benchmark] " << threads[tIdx] << " thread(s): " << pagesPerSecond(samples, threads[tIdx]) << " pages/s";
+
+	QThreadPool::globalInstance()->setMaxThreadCount(defaultThreads);
+
+	return true;
+}
+
+/**
+* Loads the pages of a directory.
+* If the directory has a ground truth file, its angles are used. Otherwise the pages are 
+* assumed to be straight and they are rotated synthetically.
+* Without a path, synthetic pages are created.
+* @param path the directory or a ground truth file (the pages are next to it)
+* @param maxPages the maximal number of samples
+* @return the samples (empty if the path does not exist)
+**/
+QVector<DkSkewSample> DkSkewBenchmark::loadSamples(const QString& path, int maxPages) {
+
+	QVector<DkSkewSample> pages;
+
+	if (path.isEmpty()) {
+
+		// A4 @ 300 dpi & 150 dpi
+		for (int idx = 0; idx < 4; idx++) {
+			QSize size = (idx % 2) ? QSize(1240, 1754) : QSize(2480, 3508);
+			pages << DkSkewSample(QString("synthetic-%1").arg(idx), createPage(size.width(), size.height(), 42 + idx));
+		}
+
+		return rotateSamples(pages, maxPages);
+	}
+
+	QFileInfo info(path);
+	if (!info.exists())
+		return pages;
+
+	QDir dir = info.isDir() ? QDir(info.absoluteFilePath()) : info.absoluteDir();
+	QString gtPath = info.isDir() ? dir.absoluteFilePath(DK_SKEW_GT_FILE) : info.absoluteFilePath();
+	QMap<QString, double> gt = loadGroundTruth(gtPath);
+
+	if (!info.isDir() && gt.isEmpty()) {
+		qWarning() << "[Skew Benchmark] no ground truth in" << gtPath;
+		return pages;
+	}
+
+	QStringList filters;
+	filters << "*.png" << "*.jpg" << "*.jpeg" << "*.tif" << "*.tiff" << "*.bmp";
+	QFileInfoList files = dir.entryInfoList(filters, QDir::Files, QDir::Name);
+
+	for (int idx = 0; idx < files.size() && pages.size() < maxPages; idx++) {
+
+		if (!gt.isEmpty() && !gt.contains(files[idx].fileName()))
+			continue;
+
+		QImage img(files[idx].absoluteFilePath());
+		if (img.isNull()) {
+			qWarning() << "[Skew Benchmark] could not load" << files[idx].absoluteFilePath();
+			continue;
+		}
+
+		pages << DkSkewSample(files[idx].fileName(), img, gt.value(files[idx].fileName(), 0.0));
+	}
+
+	if (gt.isEmpty())
+		return rotateSamples(pages, maxPages);
+
+	return pages;
+}
+
+/**
+* Rotates straight pages by known angles.
+* The estimator should return the negative angle (it returns the angle which deskews the page).
+* The rotated pages are cropped so that the image borders do not add edges.
+* @param pages the straight pages
+* @param maxPages the maximal number of samples
+* @return the rotated pages
+**/
+QVector<DkSkewSample> DkSkewBenchmark::rotateSamples(const QVector<DkSkewSample>& pages, int maxPages) {
+
+	QVector<double> angles;
+	angles << -7.3 << -2.45 << -0.8 << 0.35 << 1.7 << 4.15 << 11.6;
+
+	int anglesPerPage = qBound(1, maxPages / qMax(pages.size(), 1), 3);
+
+	QVector<DkSkewSample> samples;
+
+	for (int pIdx = 0; pIdx < pages.size() && samples.size() < maxPages; pIdx++) {
+		for (int aIdx = 0; aIdx < anglesPerPage && samples.size() < maxPages; aIdx++) {
+
+			double angle = angles[(pIdx * anglesPerPage + aIdx) % angles.size()];
+
+			DkTransformStack rotation;
+			rotation.setRotation(angle);
+			rotation.setCropEnabled(true);
+
+			samples << DkSkewSample(QString("%1 (%2)").arg(pages[pIdx].name).arg(angle), rotation.apply(pages[pIdx].img), -angle);
+		}
+	}
+
+	return samples;
+}
+
+/**
+* Creates a synthetic text page: lines of black words with a paragraph break now and then.
+* @param width the page width
+* @param height the page height
+* @param seed seed of the word lengths and paragraph breaks
+* @return the page (RGB32)
+**/
+QImage DkSkewBenchmark::createPage(int width, int height, int seed) {
+
+	QImage img(width, height, QImage::Format_RGB32);
+	img.fill(Qt::white);
+
+	QPainter painter(&img);
+	painter.setPen(Qt::NoPen);
+	painter.setBrush(Qt::black);
+
+	int margin = width / 10;
+	int lineHeight = qMax(height / 60, 4);
+	int xHeight = qMax(lineHeight * 2 / 5, 2);
+	int space = qMax(xHeight / 2, 1);
+
+	cv::RNG rng(seed);
+
+	for (int y = margin; y < height - margin - lineHeight; y += lineHeight) {
+
+		// paragraph break
+		if (rng.uniform(0, 8) == 0) {
+			y += lineHeight;
+			continue;
+		}
+
+		for (int x = margin; x < width - margin; ) {
+
+			int wordLength = xHeight * rng.uniform(1, 9);
+			wordLength = qMin(wordLength, width - margin - x);
+
+			painter.drawRect(x, y, wordLength, xHeight);
+			x += wordLength + space;
+		}
+	}
+
+	return img;
+}
+
+/**
+* Runs the estimator without GUI.
+* @param img the page
+* @param coarseToFine if true, large pages are processed on a pyramid
+* @param stageTimes the time of each stage (ms)
+* @param ms the total time (ms)
+* @return the estimated angle (degrees)
+**/
+double DkSkewBenchmark::estimate(const QImage& img, bool coarseToFine, QVector<double>& stageTimes, double& ms) {
+
+	QElapsedTimer dt;
+	dt.start();
+
+	DkSkewEstimator skewEstimator;
+	skewEstimator.setCoarseToFine(coarseToFine);
+	skewEstimator.setImage(img);
+	double angle = skewEstimator.getSkewAngle();
+
+	ms = dt.nsecsElapsed() * 1e-6;
+	stageTimes = skewEstimator.stageTimes();
+
+	return angle;
+}
+
+/**
+* Estimates the skew of all samples in parallel - like the batch processing does.
+* The estimator uses the global thread pool, hence its thread count is changed
+* (which is why the benchmark runs in its own process and not in the plugin).
+* The nested maps of the estimators do not block since headless estimators run their work on the calling thread too.
+* @param samples the pages
+* @param numThreads the number of threads
+* @return the number of pages per second
+**/
+double DkSkewBenchmark::pagesPerSecond(const QVector<DkSkewSample>& samples, int numThreads) {
+
+	if (samples.isEmpty() || numThreads < 1)
+		return 0.0;
+
+	QThreadPool::globalInstance()->setMaxThreadCount(numThreads);
+
+	QVector<int> indices;
+	for (int idx = 0; idx < samples.size(); idx++)
+		indices << idx;
+
+	QElapsedTimer dt;
+	dt.start();
+
+	QtConcurrent::blockingMap(indices, [&](const int& idx) {
+
+		DkSkewEstimator skewEstimator;
+		skewEstimator.setImage(samples[idx].img);
+		skewEstimator.getSkewAngle();
+	});
+
+	qint64 ns = dt.nsecsElapsed();
+
+	return (ns > 0) ? samples.size() / (ns * 1e-9) : 0.0;
+}
+
+/**
+* Reads the ground truth file.
+* Each line holds a file name and the angle (degrees) the estimator should return, separated by a semicolon.
+* Lines that cannot be parsed (e.g. a header) are skipped.
+* @param filePath the csv file
+* @return the angles of all files
+**/
+QMap<QString, double> DkSkewBenchmark::loadGroundTruth(const QString& filePath) {
+
+	QMap<QString, double> gt;
+	QFile file(filePath);
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+		return gt;
+
+	QTextStream stream(&file);
+
+	while (!stream.atEnd()) {
+
+		QStringList values = stream.readLine().split(";");
+		if (values.size() < 2)
+			continue;
+
+		bool ok = false;
+		double angle = values[1].trimmed().toDouble(&ok);
+
+		if (ok)
+			gt.insert(values[0].trimmed(), angle);
+	}
+
+	return gt;
+}
+
+/**
+* Writes the distribution of the absolute errors (degrees) to the debug output.
+**/
+void DkSkewBenchmark::reportErrors(const QVector<double>& errors) {
+
+	if (errors.isEmpty())
+		return;
+
+	QVector<double> sorted = errors;
+	std::sort(sorted.begin(), sorted.end());
+
+	double sum = 0;
+	int below01 = 0;
+	int below05 = 0;
+
+	for (int idx = 0; idx < sorted.size(); idx++) {
+		sum += sorted[idx];
+		if (sorted[idx] < 0.1) below01++;
+		if (sorted[idx] < 0.5) below05++;
+	}
+
+	qDebug().nospace() << "[Skew Benchmark] " << sorted.size() << " pages - error mean: " << sum / sorted.size()
+		<< " median: " << percentile(sorted, 0.5) << " 90%: " << percentile(sorted, 0.9) << " max: " << sorted.last()
+		<< " < 0.1 deg: " << 100.0 * below01 / sorted.size() << "% < 0.5 deg: " << 100.0 * below05 / sorted.size() << "%";
+}
+
+/**
+* @param values sorted values
+* @param p the percentile [0 1]
+* @return the value at the percentile (nearest rank)
+**/
+double DkSkewBenchmark::percentile(const QVector<double>& values, double p) {
+
+	if (values.isEmpty())
+		return 0.0;
+
+	int idx = qBound(0, qCeil(p * values.size()) - 1, values.size() - 1);
+
+	return values[idx];
+}
+
+};
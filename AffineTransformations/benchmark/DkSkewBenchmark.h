@@ -0,0 +1,75 @@
+/*******************************************************************************************************
+ DkSkewBenchmark.h
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QString>
+#include <QMap>
+
+namespace nmp {
+
+/**
+* A document page with known skew.
+* skewGt is the angle the estimator should return, i.e. the angle which deskews the page.
+**/
+class DkSkewSample {
+
+public:
+	DkSkewSample(const QString& name = QString(), const QImage& img = QImage(), double skewGt = 0.0);
+
+	QString name;
+	QImage img;
+	double skewGt;
+};
+
+/**
+* Accuracy and speed benchmark of the skew estimation (skewBenchmark executable).
+* Pages with known skew are loaded from a directory or a ground truth file (skew-gt.csv) or rotated synthetically.
+* The estimator runs headlessly and the error distribution, the time of each stage,
+* the coarse-to-fine speedup and the throughput per thread count are written to the debug output.
+**/
+class DkSkewBenchmark {
+
+public:
+	static bool run(const QString& path = QString(), int maxPages = 50);
+
+	static QVector<DkSkewSample> loadSamples(const QString& path, int maxPages);
+	static QVector<DkSkewSample> rotateSamples(const QVector<DkSkewSample>& pages, int maxPages);
+	static QImage createPage(int width, int height, int seed);
+
+	static double estimate(const QImage& img, bool coarseToFine, QVector<double>& stageTimes, double& ms);
+	static double pagesPerSecond(const QVector<DkSkewSample>& samples, int numThreads);
+
+protected:
+	static QMap<QString, double> loadGroundTruth(const QString& filePath);
+	static void reportErrors(const QVector<double>& errors);
+	static double percentile(const QVector<double>& values, double p);
+};
+
+};
@@ -0,0 +1,54 @@
+/*******************************************************************************************************
+ main.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkSkewBenchmark.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+/**
+* Usage: skewBenchmark [directory | skew-gt.csv] [maxPages]
+* Without a path, synthetic pages are evaluated.
+* @return 0 if the pages were evaluated
+**/
+int main(int argc, char *argv[]) {
+
+	// no GUI - the estimators do not create a progress dialog without a main window
+	QCoreApplication app(argc, argv);
+	QStringList args = app.arguments();
+
+	QString path = args.size() > 1 ? args[1] : QString();
+	int maxPages = args.size() > 2 ? args[2].toInt() : 50;
+
+	if (maxPages < 1) {
+		qWarning("usage: skewBenchmark [directory | skew-gt.csv] [maxPages]");
+		return 2;
+	}
+
+	return nmp::DkSkewBenchmark::run(path, maxPages) ? 0 : 1;
+}
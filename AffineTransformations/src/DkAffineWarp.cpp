@@ -0,0 +1,417 @@
+/*******************************************************************************************************
+ DkAffineWarp.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkAffineWarp.h"
+
+#include <QDebug>
+#include <QPair>
+#include <QtConcurrentMap>
+#include <QtCore/qmath.h>
+
+#include <cstring>
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+#define DK_WARP_PHASES 256			// sub-pixel positions of the precomputed kernel weights
+#define DK_WARP_MAX_RADIUS 3		// radius of the largest kernel (Lanczos 3)
+#define DK_WARP_BAND_HEIGHT 32		// rows per parallel band
+
+namespace nmp {
+
+/**
+* Warps an image with an affine transformation.
+* The source is mapped with transform into a dstSize image, areas which are not covered are filled with bgColor.
+* Border pixels are blended with bgColor according to their coverage.
+* This function is thread-safe.
+* @param src the source image
+* @param transform maps source coordinates to destination coordinates (must be affine)
+* @param dstSize the size of the resulting image
+* @param interpolation interp_bilinear | interp_bicubic | interp_lanczos
+* @param bgColor the background color
+* @return the warped image (Grayscale8, RGB32 or ARGB32_Premultiplied) or a null image if the transform is not invertible
+**/
+QImage DkAffineWarp::warp(const QImage& src, const QTransform& transform, const QSize& dstSize, int interpolation, const QColor& bgColor) {
+
+	if (src.isNull() || dstSize.isEmpty())
+		return QImage();
+
+	if (transform.type() > QTransform::TxShear) {
+		qWarning() << "[DkAffineWarp] projective transformations are not supported";
+		return QImage();
+	}
+
+	bool invertible = false;
+	QTransform inverse = transform.inverted(&invertible);
+
+	if (!invertible)
+		return QImage();
+
+	if (interpolation < 0 || interpolation >= interp_end)
+		interpolation = interp_bicubic;
+
+	const QImage cImg = toSupportedFormat(src);
+	QImage dst(dstSize, cImg.format());
+
+	if (dst.isNull()) {
+		qWarning() << "[DkAffineWarp] cannot allocate" << dstSize;
+		return dst;
+	}
+
+	int channels = (cImg.depth() == 8) ? 1 : 4;
+	bool premultiplied = cImg.format() == QImage::Format_ARGB32_Premultiplied;
+
+	QRgb bg;
+	if (channels == 1)
+		bg = qGray(bgColor.rgb());
+	else if (premultiplied)
+		bg = qPremultiply(bgColor.rgba());
+	else
+		bg = bgColor.rgb();
+
+	QVector<float> weights = weightTable(interpolation);
+	int radius = kernelRadius(interpolation);
+
+	// workers must not call the (detaching) QImage accessors
+	const uchar* srcBits = cImg.constBits();
+	int srcBpl = cImg.bytesPerLine();
+	uchar* dstBits = dst.bits();
+	int dstBpl = dst.bytesPerLine();
+	QSize srcSize = cImg.size();
+
+	QVector<QPair<int, int> > bands;
+	for (int r = 0; r < dst.height(); r += DK_WARP_BAND_HEIGHT)
+		bands << qMakePair(r, qMin(r + DK_WARP_BAND_HEIGHT, dst.height()));
+
+	auto processBand = [&](const QPair<int, int>& band) {
+		warpRows(srcBits, srcBpl, srcSize, dstBits, dstBpl, dstSize.width(),
+			channels, premultiplied, inverse, weights, radius, bg, band.first, band.second);
+	};
+
+	QtConcurrent::blockingMap(bands, processBand);
+
+	dst.setDotsPerMeterX(src.dotsPerMeterX());
+	dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+	return dst;
+}
+
+/**
+* @return true if the warp can read the format directly (Grayscale8 | RGB32 | ARGB32_Premultiplied)
+**/
+bool DkAffineWarp::isSupportedFormat(QImage::Format format) {
+
+	return format == QImage::Format_Grayscale8 ||
+		format == QImage::Format_RGB32 ||
+		format == QImage::Format_ARGB32_Premultiplied;
+}
+
+/**
+* Converts an image to a format that is supported by the warp.
+* Gray images are kept with 8 bit, images with alpha channel are premultiplied so that the
+* interpolation does not bleed colors of transparent pixels.
+**/
+QImage DkAffineWarp::toSupportedFormat(const QImage& img) {
+
+	if (isSupportedFormat(img.format()))
+		return img;
+
+	if (img.format() == QImage::Format_Indexed8 && img.isGrayscale())
+		return img.convertToFormat(QImage::Format_Grayscale8);
+	else if (img.hasAlphaChannel())
+		return img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+	return img.convertToFormat(QImage::Format_RGB32);
+}
+
+int DkAffineWarp::kernelRadius(int interpolation) {
+
+	switch (interpolation) {
+	case interp_bilinear:	return 1;
+	case interp_lanczos:	return 3;
+	default:				return 2;
+	}
+}
+
+/**
+* Evaluates the interpolation kernel.
+* @param interpolation the kernel type
+* @param d the distance to the sample
+**/
+double DkAffineWarp::kernel(int interpolation, double d) {
+
+	d = qAbs(d);
+
+	switch (interpolation) {
+
+	case interp_bilinear:
+		return qMax(1.0 - d, 0.0);
+
+	case interp_lanczos: {
+		if (d < 1e-8)
+			return 1.0;
+		if (d >= 3.0)
+			return 0.0;
+
+		double pd = M_PI * d;
+		return 3.0 * qSin(pd) * qSin(pd / 3.0) / (pd * pd);
+	}
+	default: {
+		// Keys cubic convolution (a = -0.5)
+		const double a = -0.5;
+
+		if (d <= 1.0)
+			return ((a + 2.0) * d - (a + 3.0)) * d * d + 1.0;
+		if (d < 2.0)
+			return ((a * d - 5.0 * a) * d + 8.0 * a) * d - 4.0 * a;
+
+		return 0.0;
+	}
+	}
+}
+
+/**
+* Precomputes the normalized kernel weights for DK_WARP_PHASES+1 sub-pixel positions.
+* The weights of phase p start at p * 2 * radius.
+**/
+QVector<float> DkAffineWarp::weightTable(int interpolation) {
+
+	int radius = kernelRadius(interpolation);
+	int taps = 2 * radius;
+
+	QVector<float> table((DK_WARP_PHASES + 1) * taps);
+
+	for (int p = 0; p <= DK_WARP_PHASES; p++) {
+
+		double f = (double)p / DK_WARP_PHASES;
+		double sum = 0;
+
+		for (int k = 0; k < taps; k++) {
+			double w = kernel(interpolation, k - radius + 1 - f);
+			table[p * taps + k] = (float)w;
+			sum += w;
+		}
+
+		for (int k = 0; k < taps; k++)
+			table[p * taps + k] = (float)(table[p * taps + k] / sum);
+	}
+
+	return table;
+}
+
+/**
+* Computes the destination columns of a row whose source position lies within the source image (+ one pixel for the coverage).
+* @return false if no pixel of the row is covered
+**/
+bool DkAffineWarp::columnRange(const QTransform& inverse, int row, const QSize& srcSize, int dstWidth, int& firstCol, int& lastCol) {
+
+	QPointF p0 = inverse.map(QPointF(0.5, row + 0.5));
+	double v0[2] = {p0.x() - 0.5, p0.y() - 0.5};
+	double dv[2] = {inverse.m11(), inverse.m12()};
+	double hi[2] = {(double)srcSize.width(), (double)srcSize.height()};
+
+	double xMin = 0;
+	double xMax = dstWidth - 1;
+
+	for (int idx = 0; idx < 2; idx++) {
+
+		if (qAbs(dv[idx]) < 1e-12) {
+			if (v0[idx] <= -1.0 || v0[idx] >= hi[idx])
+				return false;
+			continue;
+		}
+
+		double t1 = (-1.0 - v0[idx]) / dv[idx];
+		double t2 = (hi[idx] - v0[idx]) / dv[idx];
+
+		xMin = qMax(xMin, qMin(t1, t2));
+		xMax = qMin(xMax, qMax(t1, t2));
+	}
+
+	firstCol = qMax(qCeil(xMin), 0);
+	lastCol = qMin(qFloor(xMax), dstWidth - 1);
+
+	return firstCol <= lastCol;
+}
+
+/**
+* Warps the rows [firstRow lastRow).
+* The source position of each pixel is updated incrementally along the row, pixels outside the
+* covered column range are filled with the background directly.
+**/
+void DkAffineWarp::warpRows(const uchar* srcBits, int srcBpl, const QSize& srcSize, uchar* dstBits, int dstBpl, int dstWidth,
+	int channels, bool premultiplied, const QTransform& inverse, const QVector<float>& weights, int radius, QRgb bg, int firstRow, int lastRow) {
+
+	int taps = 2 * radius;
+	int srcW = srcSize.width();
+	int srcH = srcSize.height();
+	const float* wTable = weights.constData();
+
+	int xs[2 * DK_WARP_MAX_RADIUS];
+	int ys[2 * DK_WARP_MAX_RADIUS];
+
+	uchar bgBytes[4];
+	std::memcpy(bgBytes, &bg, sizeof(bgBytes));
+
+#ifdef DK_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bgI = _mm_cvtsi32_si128((int)bg);
+	const __m128 bgF = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bgI, zero), zero));
+#endif
+
+	for (int r = firstRow; r < lastRow; r++) {
+
+		uchar* dstLine = dstBits + (qint64)r * dstBpl;
+
+		int firstCol = 0, lastCol = -1;
+		if (!columnRange(inverse, r, srcSize, dstWidth, firstCol, lastCol)) {
+			firstCol = dstWidth;
+			lastCol = dstWidth - 1;
+		}
+
+		// background
+		if (channels == 1) {
+			std::memset(dstLine, bgBytes[0], firstCol);
+			std::memset(dstLine + lastCol + 1, bgBytes[0], dstWidth - lastCol - 1);
+		}
+		else {
+			QRgb* dPtr = (QRgb*)dstLine;
+			for (int c = 0; c < firstCol; c++)
+				dPtr[c] = bg;
+			for (int c = lastCol + 1; c < dstWidth; c++)
+				dPtr[c] = bg;
+		}
+
+		// source position of the first pixel center - then step along the row
+		QPointF p = inverse.map(QPointF(firstCol + 0.5, r + 0.5));
+		double sx = p.x() - 0.5;
+		double sy = p.y() - 0.5;
+		const double dsx = inverse.m11();
+		const double dsy = inverse.m12();
+
+		for (int c = firstCol; c <= lastCol; c++, sx += dsx, sy += dsy) {
+
+			int ix = qFloor(sx);
+			int iy = qFloor(sy);
+
+			const float* wx = wTable + qRound((sx - ix) * DK_WARP_PHASES) * taps;
+			const float* wy = wTable + qRound((sy - iy) * DK_WARP_PHASES) * taps;
+
+			// replicate the border
+			for (int k = 0; k < taps; k++) {
+				xs[k] = qBound(0, ix - radius + 1 + k, srcW - 1);
+				ys[k] = qBound(0, iy - radius + 1 + k, srcH - 1);
+			}
+
+			// fraction of the pixel that is covered by the source image
+			float cov = (float)(qBound(0.0, qMin(sx + 1.0, srcW - sx), 1.0) * qBound(0.0, qMin(sy + 1.0, srcH - sy), 1.0));
+
+			if (channels == 1) {
+
+				float acc = 0;
+				for (int j = 0; j < taps; j++) {
+
+					const uchar* sLine = srcBits + (qint64)ys[j] * srcBpl;
+					float h = 0;
+					for (int i = 0; i < taps; i++)
+						h += wx[i] * sLine[xs[i]];
+					acc += wy[j] * h;
+				}
+
+				if (cov < 1.0f)
+					acc = acc * cov + bgBytes[0] * (1.0f - cov);
+
+				dstLine[c] = (uchar)qBound(0, qRound(acc), 255);
+				continue;
+			}
+
+			QRgb v;
+
+#ifdef DK_SSE2
+			__m128 acc = _mm_setzero_ps();
+
+			for (int j = 0; j < taps; j++) {
+
+				const QRgb* sLine = (const QRgb*)(srcBits + (qint64)ys[j] * srcBpl);
+				__m128 h = _mm_setzero_ps();
+
+				for (int i = 0; i < taps; i++) {
+					__m128i px = _mm_cvtsi32_si128((int)sLine[xs[i]]);
+					px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+					h = _mm_add_ps(h, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(wx[i])));
+				}
+
+				acc = _mm_add_ps(acc, _mm_mul_ps(h, _mm_set1_ps(wy[j])));
+			}
+
+			if (cov < 1.0f)
+				acc = _mm_add_ps(_mm_mul_ps(acc, _mm_set1_ps(cov)), _mm_mul_ps(bgF, _mm_set1_ps(1.0f - cov)));
+
+			// round & saturate to 8 bit
+			__m128i out = _mm_cvtps_epi32(acc);
+			out = _mm_packs_epi32(out, out);
+			out = _mm_packus_epi16(out, out);
+			v = (QRgb)_mm_cvtsi128_si32(out);
+#else
+			float acc[4] = {0, 0, 0, 0};
+
+			for (int j = 0; j < taps; j++) {
+
+				const uchar* sLine = srcBits + (qint64)ys[j] * srcBpl;
+				float h[4] = {0, 0, 0, 0};
+
+				for (int i = 0; i < taps; i++) {
+					const uchar* px = sLine + xs[i] * 4;
+					for (int ch = 0; ch < 4; ch++)
+						h[ch] += wx[i] * px[ch];
+				}
+
+				for (int ch = 0; ch < 4; ch++)
+					acc[ch] += wy[j] * h[ch];
+			}
+
+			uchar out[4];
+			for (int ch = 0; ch < 4; ch++) {
+				float val = (cov < 1.0f) ? acc[ch] * cov + bgBytes[ch] * (1.0f - cov) : acc[ch];
+				out[ch] = (uchar)qBound(0, qRound(val), 255);
+			}
+			std::memcpy(&v, out, sizeof(v));
+#endif
+
+			// overshooting kernels must not create colors brighter than their alpha
+			if (premultiplied) {
+				int a = qAlpha(v);
+				v = qRgba(qMin(qRed(v), a), qMin(qGreen(v), a), qMin(qBlue(v), a), a);
+			}
+
+			((QRgb*)dstLine)[c] = v;
+		}
+	}
+}
+
+};
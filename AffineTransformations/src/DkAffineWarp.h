@@ -0,0 +1,68 @@
+/*******************************************************************************************************
+ DkAffineWarp.h
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QTransform>
+#include <QColor>
+#include <QVector>
+
+namespace nmp {
+
+/**
+* Resamples images with an affine transformation.
+* Each destination pixel is mapped back to the source where it is interpolated with a separable kernel.
+* The source coordinates are updated incrementally along a row and the rows are processed in parallel bands.
+**/
+class DkAffineWarp {
+
+public:
+	enum {
+		interp_bilinear = 0,
+		interp_bicubic,
+		interp_lanczos,
+
+		interp_end,
+	};
+
+	static QImage warp(const QImage& src, const QTransform& transform, const QSize& dstSize, int interpolation = interp_bicubic, const QColor& bgColor = Qt::white);
+
+	static bool isSupportedFormat(QImage::Format format);
+	static QImage toSupportedFormat(const QImage& img);
+
+protected:
+	static int kernelRadius(int interpolation);
+	static double kernel(int interpolation, double d);
+	static QVector<float> weightTable(int interpolation);
+
+	static void warpRows(const uchar* srcBits, int srcBpl, const QSize& srcSize, uchar* dstBits, int dstBpl, int dstWidth,
+		int channels, bool premultiplied, const QTransform& inverse, const QVector<float>& weights, int radius, QRgb bg, int firstRow, int lastRow);
+	static bool columnRange(const QTransform& inverse, int row, const QSize& srcSize, int dstWidth, int& firstCol, int& lastCol);
+};
+
+};
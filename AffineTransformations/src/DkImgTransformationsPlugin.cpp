@@ -31,10 +31,18 @@
 #include "DkMath.h"
 #include "DkBaseViewPort.h"
 #include "DkUtils.h"
+#include "DkImageContainer.h"
+#include "DkMetaData.h"
 
 #include <QMouseEvent>
+#include <QThread>
+#include <QApplication>
+#include <QRegExp>
+#include <QtConcurrentRun>
 
 #define PI 3.14159265
+#define DK_PROXY_MAX_SCALE 0.75		// a proxy is only created if it is noticeably smaller than the image
+#define DK_DESKEW_EXIF_KEY "Exif.Photo.UserComment"	// the estimated skew is appended to this comment by the batch deskew
 
 namespace nmp {
 
@@ -45,6 +53,29 @@ namespace nmp {
 **/
 DkImgTransformationsPlugin::DkImgTransformationsPlugin() {
 
+	// create run IDs
+	QVector<QString> runIds;
+	runIds.resize(id_end);
+
+	runIds[id_deskew] = "3c0e6f1b9d2a4e57a8b4c6d2f0e19a73";
+	runIds[id_transform] = "b84d2e6a0f7c4913a5e8d1c63f2b9e07";
+	mRunIDs = runIds.toList();
+
+	// create menu actions
+	QVector<QString> menuNames;
+	menuNames.resize(id_end);
+
+	menuNames[id_deskew] = tr("Deskew");
+	menuNames[id_transform] = tr("Transform (Last Settings)");
+	mMenuNames = menuNames.toList();
+
+	// create menu status tips
+	QVector<QString> statusTips;
+	statusTips.resize(id_end);
+
+	statusTips[id_deskew] = tr("Estimates the skew of a document page, rotates the image and saves the angle to the metadata - use this action for batch processing.");
+	statusTips[id_transform] = tr("Applies the scale, rotation, shear and crop of the last transformation in one pass - use this action for batch processing.");
+	mMenuStatusTips = statusTips.toList();
 }
 
 /**
@@ -77,6 +108,27 @@ bool DkImgTransformationsPlugin::hideHUD() const {
 	return false;
 }
 
+QList<QAction*> DkImgTransformationsPlugin::createActions(QWidget* parent) {
+
+	if (mActions.empty()) {
+
+		for (int idx = 0; idx < id_end; idx++) {
+			QAction* ca = new QAction(mMenuNames[idx], parent);
+			ca->setObjectName(mMenuNames[idx]);
+			ca->setStatusTip(mMenuStatusTips[idx]);
+			ca->setData(mRunIDs[idx]);	// runID needed for calling function runPlugin()
+			mActions.append(ca);
+		}
+	}
+
+	return mActions;
+}
+
+QList<QAction*> DkImgTransformationsPlugin::pluginActions() const {
+
+	return mActions;
+}
+
 /**
 * Main function: runs plugin based on its ID
 * @param run ID
@@ -84,6 +136,11 @@ bool DkImgTransformationsPlugin::hideHUD() const {
 **/
 QSharedPointer<nmc::DkImageContainer> DkImgTransformationsPlugin::runPlugin(const QString &runID, QSharedPointer<nmc::DkImageContainer> imgC) const {
 
+	if (imgC && runID == mRunIDs[id_deskew])
+		return runDeskew(imgC);
+	else if (imgC && runID == mRunIDs[id_transform])
+		return runTransform(imgC);
+
 	//for a mViewport plugin runID and image are null
 	if (mViewport && imgC) {
 
@@ -102,6 +159,80 @@ QSharedPointer<nmc::DkImageContainer> DkImgTransformationsPlugin::runPlugin(cons
 	return imgC;
 };
 
+/**
+* Estimates the skew, rotates the image (cropped if enabled in the viewport) and writes the angle to the metadata.
+* This function is thread-safe - the batch processing runs it for several images in parallel.
+**/
+QSharedPointer<nmc::DkImageContainer> DkImgTransformationsPlugin::runDeskew(QSharedPointer<nmc::DkImageContainer> imgC) const {
+
+	QImage img = imgC->image();
+	if (img.width() <= 10 || img.height() <= 10)
+		return imgC;
+
+	QSettings settings;	// each thread needs its own QSettings object
+	settings.beginGroup("affineTransformPlugin");
+	bool crop = (settings.value("cropEnabled", Qt::Unchecked).toInt() == Qt::Checked);
+	int interpolation = settings.value("interpolation", DkAffineWarp::interp_bicubic).toInt();
+	settings.endGroup();
+
+	// the progress dialog is only shown if we run in the GUI thread
+	QWidget* mainWin = (QThread::currentThread() == QApplication::instance()->thread()) ? getMainWindow() : 0;
+
+	DkSkewEstimator skewEstimator(mainWin);
+	skewEstimator.setImage(img);
+	double angle = skewEstimator.getSkewAngle();
+
+	if (angle != 0) {
+		DkTransformStack rotation;
+		rotation.setRotation(angle);
+		rotation.setCropEnabled(crop);
+		imgC->setImage(rotation.apply(img, interpolation), tr("Deskewed"));
+	}
+
+	QSharedPointer<nmc::DkMetaDataT> metaData = imgC->getMetaData();
+	if (metaData) {
+
+		// keep the user's comment - only a previous skew entry is replaced
+		QString comment = metaData->getExifValue("UserComment");	// searches Exif.Image & Exif.Photo
+		QString skewInfo = QString("skew: %1").arg(angle, 0, 'f', 2);
+		QRegExp skewExp("skew: -?\\d+\\.\\d+");
+
+		if (comment.contains(skewExp))
+			comment.replace(skewExp, skewInfo);
+		else if (comment.trimmed().isEmpty())
+			comment = skewInfo;
+		else
+			comment += "; " + skewInfo;
+
+		metaData->setExifValue(DK_DESKEW_EXIF_KEY, comment);
+	}
+
+	return imgC;
+}
+
+/**
+* Applies the transformation of the last viewport session.
+* This function is thread-safe.
+**/
+QSharedPointer<nmc::DkImageContainer> DkImgTransformationsPlugin::runTransform(QSharedPointer<nmc::DkImageContainer> imgC) const {
+
+	QSettings settings;	// each thread needs its own QSettings object
+	DkTransformStack stack;
+	stack.loadSettings(settings);
+
+	settings.beginGroup("affineTransformPlugin");
+	int interpolation = settings.value("interpolation", DkAffineWarp::interp_bicubic).toInt();
+	settings.endGroup();
+
+	QImage img = imgC->image();
+	if (img.isNull() || stack.isIdentity())
+		return imgC;
+
+	imgC->setImage(stack.apply(img, interpolation), tr("Transformed"));
+
+	return imgC;
+}
+
 /**
 * returns ImgTransformationsViewPort
 **/
@@ -148,6 +279,7 @@ void DkImgTransformationsViewPort::init() {
     guideMode = settings.value("guideMode", guide_no_guide).toInt();
 	rotCropEnabled = (settings.value("cropEnabled", Qt::Unchecked).toInt() == Qt::Checked);
 	angleLinesEnabled = (settings.value("angleLines", Qt::Checked).toInt() == Qt::Checked);
+	interpolation = settings.value("interpolation", DkAffineWarp::interp_bicubic).toInt();
     settings.endGroup();
 
 	selectedMode = defaultMode;
@@ -163,6 +295,9 @@ void DkImgTransformationsViewPort::init() {
 	insideIntrRect = false;
 	intrIdx = 100;
 	rotationCenter = QPoint();
+	interacting = false;
+	proxyKey = 0;
+	proxyJobKey = 0;
 
 	intrRect = new DkInteractionRects(this);
 	skewEstimator = DkSkewEstimator(this);
@@ -172,6 +307,7 @@ void DkImgTransformationsViewPort::init() {
 	imgTransformationsToolbar->setCropState((rotCropEnabled) ? Qt::Checked : Qt::Unchecked);
 	imgTransformationsToolbar->setGuideLineState(guideMode);
 	imgTransformationsToolbar->setAngleLineState((angleLinesEnabled) ? Qt::Checked : Qt::Unchecked);
+	imgTransformationsToolbar->setInterpolation(interpolation);
 
 	connect(imgTransformationsToolbar, SIGNAL(scaleXValSignal(double)), this, SLOT(setScaleXValue(double)));
 	connect(imgTransformationsToolbar, SIGNAL(scaleYValSignal(double)), this, SLOT(setScaleYValue(double)));
@@ -183,9 +319,11 @@ void DkImgTransformationsViewPort::init() {
 	connect(imgTransformationsToolbar, SIGNAL(showLinesSignal(bool)), this, SLOT(	setAngleLinesEnabled(bool)));
 	connect(imgTransformationsToolbar, SIGNAL(modeChangedSignal(int)), this, SLOT(setMode(int)));
 	connect(imgTransformationsToolbar, SIGNAL(guideStyleSignal(int)), this, SLOT(setGuideStyle(int)));
+	connect(imgTransformationsToolbar, SIGNAL(interpolationSignal(int)), this, SLOT(setInterpolation(int)));
 	connect(imgTransformationsToolbar, SIGNAL(panSignal(bool)), this, SLOT(setPanning(bool)));
 	connect(imgTransformationsToolbar, SIGNAL(cancelSignal()), this, SLOT(discardChangesAndClose()));
 	connect(imgTransformationsToolbar, SIGNAL(applySignal()), this, SLOT(applyChangesAndClose()));
+	connect(&proxyWatcher, SIGNAL(finished()), this, SLOT(proxyFinished()));
 
 }
 
@@ -209,6 +347,10 @@ void DkImgTransformationsViewPort::mousePressEvent(QMouseEvent *event) {
 		return;
 	}
 
+	// the live transform is painted with a screen resolution proxy until the mouse is released
+	if (event->buttons() == Qt::LeftButton)
+		interacting = true;
+
 	if (selectedMode == mode_scale) {
 		QVector<QRect> rects = intrRect->getInteractionRects();
 		int currIdx;
@@ -359,6 +501,12 @@ void DkImgTransformationsViewPort::mouseReleaseEvent(QMouseEvent *event) {
 	insideIntrRect = false;
 	intrIdx = 100;
 
+	// repaint with the full resolution image
+	if (interacting) {
+		interacting = false;
+		update();
+	}
+
 	// panning -> redirect to mViewport
 	if (event->modifiers() == nmc::Settings::param().global().altMod || panning) {
 		setCursor(defaultCursor);
@@ -386,6 +534,10 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 	QRect imgRectT = imgRect;
 	QTransform affineTransform = QTransform();
 
+	// zoom changes end up here - the proxy for the next drag is prepared in the background
+	if (!interacting)
+		updateProxy();
+
 	QPainter painter(this);
 
 	painter.fillRect(this->rect(), nmc::Settings::param().display().bgColor);
@@ -394,46 +546,26 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 	if (mWorldMatrix)
 		painter.setWorldTransform((*mImgMatrix) * (*mWorldMatrix));
 
-	if (selectedMode == mode_scale) {
-		painter.save();
-
-		imgRectT.setSize(QSize(imgRectT.width()*scaleValues.x(),imgRectT.height()*scaleValues.y()));
-		imgRectT.translate(imgRectT.width()*0.5 *(1-scaleValues.x()) * (1/scaleValues.x()),imgRectT.height()*0.5*(1-scaleValues.y())*(1/scaleValues.y()));
-
-		affineTransform.scale(scaleValues.x(),scaleValues.y());
-		affineTransform.translate(inImage.width()*0.5 *(1-scaleValues.x()) * (1/scaleValues.x()),inImage.height()*0.5*(1-scaleValues.y())*(1/scaleValues.y()));
-	}
-	else if (selectedMode == mode_rotate) {
-		painter.save();
-
-		double diag = qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width());
-		double initAngle = qAcos(inImage.width()/diag) * 180 / PI;	
-		affineTransform.translate(0.5* inImage.width() - diag*0.5*qCos((initAngle+rotationValue) * PI / 180.0), 0.5* inImage.height() - diag*0.5*qSin((initAngle+rotationValue) * PI / 180.0));
-		affineTransform.rotate(rotationValue);
+	// all operations are previewed around the image center
+	DkTransformStack stack = transformStack();
+	QPointF center(0.5*inImage.width(), 0.5*inImage.height());
+	affineTransform = QTransform::fromTranslate(-center.x(), -center.y()) * stack.linearTransform() * QTransform::fromTranslate(center.x(), center.y());
+	imgRectT = affineTransform.mapRect(inImage.rect());
 
-		painter.fillRect(affineTransform.mapRect(inImage.rect()), Qt::white);
-		imgRectT = affineTransform.mapRect(inImage.rect());
-	}
-	else if (selectedMode == mode_shear) {
-
-		affineTransform.shear(shearValues.x(), shearValues.y());
+	painter.save();
 
-		QRect transfRect = affineTransform.mapRect(inImage.rect());
-		int signX = (shearValues.x() < 0) ? -1 : 1;
-		int signY = (shearValues.y() < 0) ? -1 : 1;
+	if (stack.rotation() != 0 || !stack.shear().isNull())
+		painter.fillRect(imgRectT, Qt::white);
 
-		affineTransform.reset();
-		affineTransform.translate(signX*(inImage.width()/2-transfRect.width()/2), signY*(inImage.height()/2-transfRect.height()/2));
-		affineTransform.shear(shearValues.x(),shearValues.y());
-
-		painter.fillRect(affineTransform.mapRect(inImage.rect()), Qt::white);
-	}
-	
 	affineTransform *= painter.transform();
 	
 	painter.setTransform(affineTransform);
 
-	painter.drawImage(inImage.rect(), inImage);
+	// the proxy is stretched to the image's rect, so all other drawings stay in image coordinates
+	if (interacting && !proxyImage.isNull())
+		painter.drawImage(inImage.rect(), proxyImage);
+	else
+		painter.drawImage(inImage.rect(), inImage);
 	
 	drawGuide(&painter, QPolygonF(QRectF(imgRect)), guideMode);
 	painter.drawRect(imgRect);
@@ -461,33 +593,89 @@ void DkImgTransformationsViewPort::paintEvent(QPaintEvent *event) {
 		}
 
 		painter.restore();
-		if (rotCropEnabled) {
-			QSize cropSize = QSize();
+	}
+	else
+		painter.restore();
 
-			double newHeight = - ((double)(inImage.height()) - (double) (inImage.width()) * qAbs(qTan(rotationValue * PI /180))) / (qAbs(qTan(rotationValue * PI /180))*qAbs(qSin(rotationValue * PI /180))-qAbs(qCos(rotationValue * PI /180)));
-			cropSize = QSize(((double) (inImage.width())-newHeight*qAbs(qSin(rotationValue * PI /180)))/qAbs(qCos(rotationValue * PI /180)) , newHeight);
-			QRect cropRect = QRect(QPoint(rotationCenter.x()-0.5*cropSize.width(),rotationCenter.y()-0.5*cropSize.height()),cropSize);
-		
-			if (cropSize.width() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width()) && cropSize.height() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width())) {
-				
-				QBrush cropBrush = QBrush(QColor(128, 128, 128, 200));
-				painter.fillRect(imgRectT.left(), imgRectT.top(), imgRectT.width(), -imgRectT.top()+cropRect.top(), cropBrush);
-				painter.fillRect(imgRectT.left(), cropRect.bottom()+1, imgRectT.width(), -cropRect.bottom()+imgRectT.bottom(), cropBrush);
-				painter.fillRect(imgRectT.left(), cropRect.top(), cropRect.left()-imgRectT.left(), cropRect.height(), cropBrush);
-				painter.fillRect(cropRect.right()+1, cropRect.top(), -cropRect.right()+imgRectT.right(), cropRect.height(), cropBrush);
+	// the crop rectangle of the transformed image - apply() crops in all modes, so it is shown in all modes
+	QSize cropSize = stack.cropSize(inImage.size());
 
-				painter.drawRect(cropRect);
+	if (!cropSize.isEmpty()) {
 
-			}
-		}
+		QRect cropRect = QRect(QPoint(qRound(center.x()-0.5*cropSize.width()), qRound(center.y()-0.5*cropSize.height())), cropSize);
+
+		QBrush cropBrush = QBrush(QColor(128, 128, 128, 200));
+		painter.fillRect(imgRectT.left(), imgRectT.top(), imgRectT.width(), -imgRectT.top()+cropRect.top(), cropBrush);
+		painter.fillRect(imgRectT.left(), cropRect.bottom()+1, imgRectT.width(), -cropRect.bottom()+imgRectT.bottom(), cropBrush);
+		painter.fillRect(imgRectT.left(), cropRect.top(), cropRect.left()-imgRectT.left(), cropRect.height(), cropBrush);
+		painter.fillRect(cropRect.right()+1, cropRect.top(), -cropRect.right()+imgRectT.right(), cropRect.height(), cropBrush);
+
+		painter.drawRect(cropRect);
 	}
-	
 
 	painter.end();
 
 	DkPluginViewPort::paintEvent(event);
 }
 
+/**
+* Creates a downscaled copy of the image that matches the current screen resolution.
+* It is painted instead of the image while the user drags a transformation.
+* The proxy is kept as long as neither the image nor the zoom level change.
+* Scaling runs in the background, until it is done the image itself is painted.
+**/
+void DkImgTransformationsViewPort::updateProxy() {
+
+	QImage img;
+
+	if(parent()) {
+		nmc::DkBaseViewPort* mViewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
+		if (mViewport)
+			img = mViewport->getImage();
+	}
+
+	if (img.isNull()) {
+		proxyImage = QImage();
+		return;
+	}
+
+	// image to screen scale
+	double scale = 1.0;
+	if (mImgMatrix)
+		scale *= mImgMatrix->m11();
+	if (mWorldMatrix)
+		scale *= mWorldMatrix->m11();
+	scale *= devicePixelRatio();
+
+	if (scale > DK_PROXY_MAX_SCALE) {
+		proxyImage = QImage();
+		return;
+	}
+
+	QSize proxySize = img.size() * scale;
+	proxySize = proxySize.expandedTo(QSize(1, 1));
+
+	if (proxyKey == img.cacheKey() && proxyImage.size() == proxySize)
+		return;
+
+	// one job at a time - proxyFinished() checks again if the zoom changed meanwhile
+	if (proxyWatcher.isRunning())
+		return;
+
+	proxyJobKey = img.cacheKey();
+	proxyWatcher.setFuture(QtConcurrent::run([img, proxySize]() {
+		return img.scaled(proxySize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}));
+}
+
+void DkImgTransformationsViewPort::proxyFinished() {
+
+	proxyImage = proxyWatcher.result();
+	proxyKey = proxyJobKey;
+
+	updateProxy();
+}
+
 void DkImgTransformationsViewPort::drawGuide(QPainter* painter, const QPolygonF& p, int paintMode) {
 
 	if (p.isEmpty() || paintMode == guide_no_guide)
@@ -548,88 +736,28 @@ QImage DkImgTransformationsViewPort::getTransformedImage() {
 		nmc::DkBaseViewPort* mViewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (mViewport) {
 
-			QImage inImage = mViewport->getImage();
-			QTransform affineTransform = QTransform();
-			
-			if (selectedMode == mode_scale) {
-
-				affineTransform.scale(scaleValues.x(),scaleValues.y());
-
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-
-				return paintedImage;
-			}
-			else if (selectedMode == mode_rotate) {			
-			
-				double diag = qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width());
-				double initAngle = qAcos(inImage.width()/diag) * 180 / PI;	
-				affineTransform.translate(0.5* inImage.width() - diag*0.5*qCos((initAngle+rotationValue) * PI / 180.0), 0.5* inImage.height() - diag*0.5*qSin((initAngle+rotationValue) * PI / 180.0));
-				affineTransform.rotate(rotationValue);
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2); 
-
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.fillRect(paintedImage.rect(), Qt::white);		
-				affineTransform.reset();
-				affineTransform.translate(paintedImage.width()/2, paintedImage.height()/2);
-				affineTransform.rotate(rotationValue); 
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-			
-				if (rotCropEnabled) {
-
-					QRect croppedImageRect = paintedImage.rect();
-
-					QSize cropSize = QSize();
-					double newHeight = - ((double)(inImage.height()) - (double) (inImage.width()) * qAbs(qTan(rotationValue * PI /180))) / (qAbs(qTan(rotationValue * PI /180))*qAbs(qSin(rotationValue * PI /180))-qAbs(qCos(rotationValue * PI /180)));
-					cropSize = QSize(((double) (inImage.width())-newHeight*qAbs(qSin(rotationValue * PI /180)))/qAbs(qCos(rotationValue * PI /180)) , newHeight);
-					if (cropSize.width() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width()) && cropSize.height() <= qSqrt(inImage.height()*inImage.height()+inImage.width()*inImage.width())) croppedImageRect = QRect(QPoint(0.5*paintedImage.width()-0.5*cropSize.width(),0.5*paintedImage.height()-0.5*cropSize.height()),cropSize);
-					QImage croppedImage = paintedImage.copy(croppedImageRect);
-
-					return croppedImage;
-				}	
-				return paintedImage;
-			}
-			else if (selectedMode == mode_shear) {			
-			
-				affineTransform.shear(shearValues.x(), shearValues.y());
-				/*
-				QRect transfRect = affineTransform.mapRect(inImage.rect());
-				int signX = (shearValues.x() < 0) ? -1 : 1;
-				int signY = (shearValues.y() < 0) ? -1 : 1;
-
-				affineTransform.reset();
-				affineTransform.translate(signX*(inImage.width()/2-transfRect.width()/2), signY*(inImage.height()/2-transfRect.height()/2));
-				affineTransform.shear(shearValues.x(),shearValues.y());
-				*/
-				QImage paintedImage = QImage(affineTransform.mapRect(inImage.rect()).size(), inImage.format());
-				QPainter imagePainter(&paintedImage);
-				imagePainter.setRenderHints(QPainter::SmoothPixmapTransform | QPainter::Antialiasing);
-				imagePainter.fillRect(paintedImage.rect(), Qt::white);		
-				affineTransform.reset();
-				affineTransform.translate(paintedImage.width()/2, paintedImage.height()/2);
-				affineTransform.shear(shearValues.x(),shearValues.y());
-				affineTransform.translate(-inImage.width()/2, -inImage.height()/2);
-				imagePainter.setTransform(affineTransform);
-				imagePainter.drawImage(QPoint(0,0), inImage);
-				imagePainter.end();
-
-				return paintedImage;
-			}
+			// all operations are applied in a single pass
+			return transformStack().apply(mViewport->getImage(), interpolation);
 		}
 	}
 
 	return QImage();
 }
 
+/**
+* @return the current scale, shear, rotation and crop
+**/
+DkTransformStack DkImgTransformationsViewPort::transformStack() const {
+
+	DkTransformStack stack;
+	stack.setScale(scaleValues);
+	stack.setShear(shearValues);
+	stack.setRotation(rotationValue);
+	stack.setCropEnabled(rotCropEnabled);
+
+	return stack;
+}
+
 void DkImgTransformationsViewPort::setMode(int mode) {
 
 	selectedMode = mode;
@@ -719,6 +847,10 @@ void DkImgTransformationsViewPort::setPanning(bool checked) {
 
 void DkImgTransformationsViewPort::applyChangesAndClose() {
 
+	// the batch action applies the last transformation
+	QSettings settings;
+	transformStack().saveSettings(settings);
+
 	cancelTriggered = false;
 	emit closePlugin();
 }
@@ -739,6 +871,11 @@ void DkImgTransformationsViewPort::setGuideStyle(int guideMode) {
 	this->repaint();
 }
 
+void DkImgTransformationsViewPort::setInterpolation(int interpolation) {
+
+	this->interpolation = interpolation;
+}
+
 void DkImgTransformationsViewPort::setVisible(bool visible) {
 
 	if(parent()) {
@@ -756,6 +893,9 @@ void DkImgTransformationsViewPort::setVisible(bool visible) {
 
 	setMode(defaultMode);
 	DkPluginViewPort::setVisible(visible);
+
+	if (visible)
+		updateProxy();
 }
 
 /*-----------------------------------DkImgTransformationsToolBar ---------------------------------------------*/
@@ -896,7 +1036,7 @@ void DkImgTransformationsToolBar::createLayout(int defaultMode) {
 	cropEnabledBox = new QCheckBox(tr("Crop Image"), this);
 	cropEnabledBox->setObjectName("cropEnabledBox");
 	cropEnabledBox->setCheckState(Qt::Unchecked);
-	cropEnabledBox->setToolTip(tr("Crop rotated image if possible"));
+	cropEnabledBox->setToolTip(tr("Crop rotated or sheared image if possible"));
 	cropEnabledBox->setStatusTip(cropEnabledBox->toolTip());
 
 
@@ -933,6 +1073,18 @@ void DkImgTransformationsToolBar::createLayout(int defaultMode) {
 	guideBox->setToolTip(tr("Show Guides in the Preview"));
 	guideBox->setStatusTip(guideBox->toolTip());
 
+	// interpolation of the resulting image
+	QStringList interpolations;
+	interpolations <<	QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Bilinear") << 
+						QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Bicubic") << 
+						QT_TRANSLATE_NOOP("nmc::DkImgTransformationsToolBar", "Lanczos");
+	interpolationBox = new QComboBox(this);
+	interpolationBox->addItems(interpolations);
+	interpolationBox->setObjectName("interpolationBox");
+	interpolationBox->setCurrentIndex(DkAffineWarp::interp_bicubic);
+	interpolationBox->setToolTip(tr("Interpolation of the transformed image"));
+	interpolationBox->setStatusTip(interpolationBox->toolTip());
+
 
 	QActionGroup* modesGroup = new QActionGroup(this);
     modesGroup->addAction(scaleAction);
@@ -976,55 +1128,36 @@ void DkImgTransformationsToolBar::createLayout(int defaultMode) {
 	toolbarWidgetList.insert(shearYBox->objectName(), this->addWidget(shearYBox));
 	addSeparator();
 	addWidget(guideBox);
+	addWidget(interpolationBox);
 
 	modifyLayout(defaultMode);
 }
 
+/**
+* Shows the controls of the selected mode.
+* All operations are applied together, so the values of the other modes and the crop option stay visible
+* (the values are read-only outside their mode).
+**/
 void DkImgTransformationsToolBar::modifyLayout(int mode) {
 
-	switch(mode) {
-		case mode_scale:
-			toolbarWidgetList.value(rotationBox->objectName())->setVisible(false);
-			#ifdef WITH_OPENCV
-			toolbarWidgetList.value(autoRotateButton->objectName())->setVisible(false);
-			toolbarWidgetList.value(showLinesBox->objectName())->setVisible(false);
-			#endif
-			toolbarWidgetList.value(cropEnabledBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(scaleXBox->objectName())->setVisible(true);
-			toolbarWidgetList.value(scaleYBox->objectName())->setVisible(true);
-			toolbarWidgetList.value(shearXBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(shearYBox->objectName())->setVisible(false);
-			scaleXBox->setValue(1);
-			scaleYBox->setValue(1);
-			break;
-		case mode_rotate:	
-			toolbarWidgetList.value(scaleXBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(scaleYBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(rotationBox->objectName())->setVisible(true);
-			#ifdef WITH_OPENCV
-			toolbarWidgetList.value(autoRotateButton->objectName())->setVisible(true);
-			toolbarWidgetList.value(showLinesBox->objectName())->setVisible(true);
-			#endif
-			toolbarWidgetList.value(cropEnabledBox->objectName())->setVisible(true);
-			toolbarWidgetList.value(shearXBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(shearYBox->objectName())->setVisible(false);
-			rotationBox->setValue(0);
-			break;
-		case mode_shear:
-			toolbarWidgetList.value(scaleXBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(scaleYBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(rotationBox->objectName())->setVisible(false);
-			#ifdef WITH_OPENCV
-			toolbarWidgetList.value(autoRotateButton->objectName())->setVisible(false);
-			toolbarWidgetList.value(showLinesBox->objectName())->setVisible(false);
-			#endif
-			toolbarWidgetList.value(cropEnabledBox->objectName())->setVisible(false);
-			toolbarWidgetList.value(shearXBox->objectName())->setVisible(true);
-			toolbarWidgetList.value(shearYBox->objectName())->setVisible(true);
-			shearXBox->setValue(0);
-			shearYBox->setValue(0);
-			break;
-	}
+	setValueBoxEditable(scaleXBox, mode == mode_scale);
+	setValueBoxEditable(scaleYBox, mode == mode_scale);
+	setValueBoxEditable(rotationBox, mode == mode_rotate);
+	setValueBoxEditable(shearXBox, mode == mode_shear);
+	setValueBoxEditable(shearYBox, mode == mode_shear);
+
+	#ifdef WITH_OPENCV
+	toolbarWidgetList.value(autoRotateButton->objectName())->setVisible(mode == mode_rotate);
+	toolbarWidgetList.value(showLinesBox->objectName())->setVisible(mode == mode_rotate);
+	#endif
+	toolbarWidgetList.value(cropEnabledBox->objectName())->setVisible(true);
+}
+
+void DkImgTransformationsToolBar::setValueBoxEditable(QDoubleSpinBox* box, bool editable) {
+
+	toolbarWidgetList.value(box->objectName())->setVisible(true);
+	box->setReadOnly(!editable);
+	box->setButtonSymbols(editable ? QAbstractSpinBox::UpDownArrows : QAbstractSpinBox::NoButtons);
 }
 
 
@@ -1133,6 +1266,12 @@ void DkImgTransformationsToolBar::on_guideBox_currentIndexChanged(int val) {
 	emit guideStyleSignal(val);
 }
 
+void DkImgTransformationsToolBar::on_interpolationBox_currentIndexChanged(int val) {
+
+	updateAffineTransformPluginSettings(val, settings_interpolation);
+	emit interpolationSignal(val);
+}
+
 void DkImgTransformationsToolBar::setRotationValue(double val) {
 
 	if (val > 180) val -= 360;
@@ -1166,6 +1305,11 @@ void DkImgTransformationsToolBar::setAngleLineState(int val) {
 	showLinesBox->setChecked(val);
 }
 
+void DkImgTransformationsToolBar::setInterpolation(int val) {
+
+	interpolationBox->setCurrentIndex(val);
+}
+
 void DkImgTransformationsToolBar::updateAffineTransformPluginSettings(int val, int type) {
 	
 	QSettings settings;
@@ -1183,6 +1327,9 @@ void DkImgTransformationsToolBar::updateAffineTransformPluginSettings(int val, i
 		case settings_lines:
 			settings.setValue("affineTransformPlugin/angleLines", val);
 			break;
+		case settings_interpolation:
+			settings.setValue("affineTransformPlugin/interpolation", val);
+			break;
 	}
 }
 
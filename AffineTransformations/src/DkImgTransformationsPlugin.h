@@ -48,9 +48,12 @@
 #include <QVector4D>
 #include <QSettings>
 #include <QMouseEvent>
+#include <QFutureWatcher>
 
 #include "DkPluginInterface.h"
 #include "DkSkewEstimator.h"
+#include "DkAffineWarp.h"
+#include "DkTransformStack.h"
 
 namespace nmp {
 
@@ -88,12 +91,28 @@ public:
     QImage image() const override;
 	bool hideHUD() const override;
 
+	QList<QAction*> createActions(QWidget* parent) override;
+	QList<QAction*> pluginActions() const override;
     QSharedPointer<nmc::DkImageContainer> runPlugin(const QString &runID = QString(), QSharedPointer<nmc::DkImageContainer> image = QSharedPointer<nmc::DkImageContainer>()) const override;
 	nmc::DkPluginViewPort* getViewPort() override;
 	void deleteViewPort();
 
+	enum {
+		id_deskew = 0,
+		id_transform,
+
+		id_end
+	};
+
 protected:
+	QSharedPointer<nmc::DkImageContainer> runDeskew(QSharedPointer<nmc::DkImageContainer> imgC) const;
+	QSharedPointer<nmc::DkImageContainer> runTransform(QSharedPointer<nmc::DkImageContainer> imgC) const;
+
 	nmc::DkPluginViewPort* mViewport = 0;
+	QList<QAction*> mActions;
+	QStringList mRunIDs;
+	QStringList mMenuNames;
+	QStringList mMenuStatusTips;
 };
 
 class DkImgTransformationsViewPort : public nmc::DkPluginViewPort {
@@ -106,6 +125,7 @@ public:
 
 	bool isCanceled();
 	QImage getTransformedImage();
+	DkTransformStack transformStack() const;
 
 public slots:
 	void setPanning(bool checked);
@@ -121,10 +141,12 @@ public slots:
 	void setCropEnabled(bool enabled);
 	void setAngleLinesEnabled(bool enabled);
 	void setGuideStyle(int guideMode);
+	void setInterpolation(int interpolation);
 
 protected slots:
 		
 	void setMode(int mode);
+	void proxyFinished();
 
 protected:
 
@@ -135,6 +157,7 @@ protected:
 	QPoint map(const QPointF &pos);
 	virtual void init();
 	void drawGuide(QPainter* painter, const QPolygonF& p, int paintMode);
+	void updateProxy();
 
 	bool cancelTriggered;
 	bool panning;
@@ -159,6 +182,12 @@ protected:
 	DkSkewEstimator skewEstimator;
 	bool angleLinesEnabled;
 	int guideMode;
+	int interpolation;
+	bool interacting;		// true while the user drags a transformation
+	QImage proxyImage;		// screen resolution copy of the image
+	qint64 proxyKey;
+	QFutureWatcher<QImage> proxyWatcher;	// the proxy is scaled in the background
+	qint64 proxyJobKey;
 };
 
 
@@ -184,6 +213,7 @@ public:
 		settings_guide,
 		settings_crop,
 		settings_lines,
+		settings_interpolation,
 
 		guide_end,
 	};
@@ -197,6 +227,7 @@ public:
 	void setCropState(int val);
 	void setGuideLineState(int val);
 	void setAngleLineState(int val);
+	void setInterpolation(int val);
 
 public slots:
 	void on_applyAction_triggered();
@@ -214,6 +245,7 @@ public slots:
 	void on_showLinesBox_stateChanged(int val);
 	void on_autoRotateButton_clicked();
 	void on_guideBox_currentIndexChanged(int val);
+	void on_interpolationBox_currentIndexChanged(int val);
 	virtual void setVisible(bool visible);
 
 signals:
@@ -230,11 +262,13 @@ signals:
 	void panSignal(bool checked);
 	void modeChangedSignal(int mode);
 	void guideStyleSignal(int guideMode);
+	void interpolationSignal(int interpolation);
 
 protected:
 	void createLayout(int defaultMode);
 	void createIcons();
 	void modifyLayout(int mode);
+	void setValueBoxEditable(QDoubleSpinBox* box, bool editable);
 	void updateAffineTransformPluginSettings(int val, int type);
 
 	QDoubleSpinBox* scaleXBox;
@@ -247,6 +281,7 @@ protected:
 	QCheckBox* showLinesBox;
 	QMap<QString, QAction*> toolbarWidgetList;
 	QComboBox* guideBox;
+	QComboBox* interpolationBox;
 
 	QAction* panAction;
 	QAction* scaleAction;
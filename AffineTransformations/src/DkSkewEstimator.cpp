@@ -26,15 +26,34 @@
  *******************************************************************************************************/
 
 #include "DkSkewEstimator.h"
-#include "DkImageStorage.h"
 
 #include <QDebug>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QPair>
+#include <QFuture>
+#include <QAtomicInt>
+#include <QtConcurrentMap>
+
+#define DK_SEP_BAND_HEIGHT 64		// rows per parallel band of the separability map
+#define DK_PROGRESS_INTERVAL 50		// ms between two progress updates
+#define DK_SKEW_REF_WIDTH 1430.0	// the method parameters are tuned for this image width
+#define DK_SKEW_REFINE_WINDOW 1.0	// the fine level searches +/- this angle (degrees) around the coarse angle
+#define DK_SALIENCY_BIN 0.01		// histogram bin width (degrees) of the line angles
+#define DK_SALIENCY_STEP 0.1		// step (degrees) between two candidate skew angles
+#define DK_SALIENCY_CHUNK 2048		// lines per parallel histogram chunk
+#define DK_WEIGHT_CHUNK 16			// Hough lines per parallel scoring task
 
 namespace nmp {
 
+/**
+* @param mainWin parent of the progress dialog - if it is 0, the estimator runs without GUI (e.g. in the batch processing)
+**/
 DkSkewEstimator::DkSkewEstimator(QWidget* mainWin) {
 
 	this->mainWin = mainWin;
+	progress = 0;
+	progressSteps = 0;
 
 	// method parameters
 	nIter = 200;
@@ -46,7 +65,11 @@ DkSkewEstimator::DkSkewEstimator(QWidget* mainWin) {
 	delta = 0; // based on image size
 	minLineLength = 10;
 	minLineProjLength = minLineLength/4;
+	minAngle = -30;
+	maxAngle = 30;
+	coarseToFine = true;
 	rotationFactor = 1;
+	stageNs = QVector<qint64>(stage_end, 0);
 
 	selectedLines.clear();
 }
@@ -57,169 +80,357 @@ DkSkewEstimator::~DkSkewEstimator() {
 
 void DkSkewEstimator::setImage(QImage inImage) {
 
-	matImg = nmc::DkImage::qImage2Mat(inImage);
-	
-	sepDims = QSize(qRound(inImage.width()/1430.0*49.0),qRound(inImage.height()/700.0*12.0));
-	delta = qRound(inImage.width()/1430.0*20.0);
-	minLineLength = qRound(inImage.width()/1430.0 * 20.0);
+	// the estimator only needs the gray values (indexed images are mapped by their color table)
+	QImage rgbImg = inImage.convertToFormat(QImage::Format_RGB888);
+	cv::Mat rgbMat(rgbImg.height(), rgbImg.width(), CV_8UC3, (void*)rgbImg.constBits(), rgbImg.bytesPerLine());
+	cv::cvtColor(rgbMat, matImg, CV_RGB2GRAY);
+
+	imgSize = inImage.size();
 	rotationFactor = 1;
 
 	if (inImage.width() < inImage.height()) {
-
 		matImg = matImg.t();
-		sepDims = QSize(qRound(inImage.width()/1430.0*49.0),qRound(inImage.height()/700.0*12.0));
-		delta = qRound(inImage.height()/1430.0*20.0);
-		minLineLength = qRound(inImage.height()/1430.0 * 20.0);
 		rotationFactor = -1;
 	}
 
+	setParameters(imgSize);
+}
+
+/**
+* If enabled, large images are first processed on a downsampled pyramid level.
+* The angle is then refined on the next finer level within a narrow window around the coarse angle.
+* Images whose next finer level is the full resolution (e.g. A4 @ 300 dpi) are processed in a single pass (see coarseLevel).
+**/
+void DkSkewEstimator::setCoarseToFine(bool enabled) {
+
+	coarseToFine = enabled;
+}
+
+/**
+* @return the run time (ms) of each stage (stage_separability ... stage_saliency) of the last getSkewAngle() call
+**/
+QVector<double> DkSkewEstimator::stageTimes() const {
+
+	QVector<double> ms(stageNs.size());
+
+	for (int idx = 0; idx < stageNs.size(); idx++)
+		ms[idx] = stageNs[idx] * 1e-6;
+
+	return ms;
+}
+
+/**
+* Scales the method parameters to the image size.
+* @param size the (scaled) image size - not transposed
+**/
+void DkSkewEstimator::setParameters(const QSize& size) {
+
+	int longSide = (size.width() < size.height()) ? size.height() : size.width();
+
+	sepDims = QSize(qRound(size.width()/DK_SKEW_REF_WIDTH*49.0),qRound(size.height()/700.0*12.0));
+	delta = qRound(longSide/DK_SKEW_REF_WIDTH*20.0);
+	minLineLength = qRound(longSide/DK_SKEW_REF_WIDTH * 20.0);
+
 	if (sepDims.width() < 1) sepDims.setWidth(1);
 	if (sepDims.height() < 1) sepDims.setHeight(1);
 
 	minLineProjLength = minLineLength/4;
 }
 
+/**
+* Returns the coarsest pyramid level (scale 1/2^level) which is not smaller than the reference width.
+* The fine pass runs on level - 1 and repeats all stages there (only the weights are pruned by the angle window).
+* If that is the full resolution image, the coarse pass would only add to a single pass - hence 0 is returned.
+* @return the coarse level (>= 2) or 0 if the image is processed in a single pass
+**/
+int DkSkewEstimator::coarseLevel() const {
+
+	int longSide = qMax(imgSize.width(), imgSize.height());
+	int level = 0;
+
+	while ((longSide >> (level + 1)) >= DK_SKEW_REF_WIDTH)
+		level++;
+
+	return (level >= 2) ? level : 0;
+}
+
 double DkSkewEstimator::getSkewAngle() {
 
-	if (!matImg.empty()) {
-		progress = new QProgressDialog(QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Calculating angle..."), QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Cancel"), 0, 100, mainWin);
+	if (matImg.empty())
+		return 0;
+
+	int level = (coarseToFine) ? coarseLevel() : 0;
+	int numRuns = (level > 0) ? 2 : 1;
+
+	progressSteps = 0;
+	stageNs.fill(0);
+
+	// without a main window (e.g. batch processing) no progress is shown
+	if (mainWin) {
+		progress = new QProgressDialog(QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Calculating angle..."), QT_TRANSLATE_NOOP("nmc::DkSkewEstimator", "Cancel"), 0, 100 * numRuns, mainWin);
 		progress->setMinimumDuration(250);
-		progress->setMaximum(100);
+		progress->setMaximum(100 * numRuns);
 		progress->setValue(0);
 		progress->setWindowModality(Qt::WindowModal);
 		progress->setModal(true);
 		progress->hide();
 		progress->show();
+	}
 
-		cv::Mat matGray;
+	cv::Mat matGray;
 
-		if (matImg.channels() > 1)
-			cv::cvtColor(matImg, matGray, CV_BGR2GRAY);
-		else matGray = matImg;
+	if (matImg.channels() > 1)
+		cv::cvtColor(matImg, matGray, CV_BGR2GRAY);
+	else matGray = matImg;
 
-		cv::Mat integral, integralSq;
-		cv::integral(matGray, integral, integralSq, CV_64F);
-		if (integral.channels() > 1) qDebug() << "Error! integral image has more than one channel";
+	double retAngle = 0;
 
-		cv::Mat separabilityHor = computeSeparability(integral, integralSq, dir_horizontal);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+	if (level > 0) {
 
-		cv::Mat separabilityVer = computeSeparability(integral, integralSq,  dir_vertical);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+		// coarse: full angle range on the smallest level
+		double scale = 1.0 / (1 << level);
+		cv::Mat coarseImg;
+		cv::resize(matGray, coarseImg, cv::Size(), scale, scale, cv::INTER_AREA);
 
-		double min, max;
-		cv::minMaxLoc(separabilityHor, &min, &max);	
-		cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, sepThr * max, dir_horizontal);
-		//cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, 0.1, dir_horizontal);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+		double coarseAngle = estimateAngle(coarseImg, scale, -30, 30);
 
-		cv::minMaxLoc(separabilityVer, &min, &max);
-		cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, sepThr * max, dir_vertical);
-		//cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, 0.1, dir_vertical);
-		if (progress->wasCanceled()) {
-			progress->deleteLater();
-			return 0;
-		}
+		// fine: narrow window on the next finer level
+		if (!wasCanceled()) {
 
-		selectedLines.clear();
+			scale *= 2.0;
+			cv::Mat fineImg = matGray;
+			if (scale < 1.0)
+				cv::resize(matGray, fineImg, cv::Size(), scale, scale, cv::INTER_AREA);
 
-		QVector<QVector3D> weightsHor = computeWeights(edgeMapHor, dir_horizontal);
-		qDebug() << weightsHor.size();
-		QVector<QVector3D> weightsVer = computeWeights(edgeMapVer, dir_vertical);
-		qDebug() << weightsVer.size();
-		if (progress->wasCanceled()) {
-			selectedLines.clear();
-			progress->deleteLater();
-			return 0;
+			retAngle = estimateAngle(fineImg, scale, coarseAngle - DK_SKEW_REFINE_WINDOW, coarseAngle + DK_SKEW_REFINE_WINDOW);
 		}
+	}
+	else
+		retAngle = estimateAngle(matGray, 1.0, -30, 30);
 
-		weightsHor += weightsVer;
- 
-		double retAngle = computeSkewAngle(weightsHor, qSqrt(matGray.rows*matGray.rows + matGray.cols*matGray.cols));
+	if (wasCanceled())
+		retAngle = 0;
 
-		progress->setValue(100);
+	setProgressValue(100 * numRuns);
+
+	if (progress) {
 		progress->deleteLater();
+		progress = 0;
+	}
 
-		return retAngle;
+	return retAngle;
+}
+
+/**
+* Estimates the skew angle of a (scaled) image.
+* The selected lines are mapped to full resolution coordinates.
+* @param img the gray value image (transposed if the image is in portrait format)
+* @param scale the scale of img with respect to the full resolution image
+* @param fromAngle the smallest angle that is considered (degrees)
+* @param toAngle the largest angle that is considered (degrees)
+* @return the skew angle in degrees or 0 if it was canceled
+**/
+double DkSkewEstimator::estimateAngle(const cv::Mat& img, double scale, double fromAngle, double toAngle) {
+
+	minAngle = fromAngle;
+	maxAngle = toAngle;
+	setParameters(QSize(qRound(imgSize.width()*scale), qRound(imgSize.height()*scale)));
+
+	cv::Mat integral, integralSq;
+	cv::integral(img, integral, integralSq, CV_64F);
+	if (integral.channels() > 1) qDebug() << "Error! integral image has more than one channel";
+
+	QElapsedTimer dt;
+	dt.start();
+
+	cv::Mat separabilityHor, separabilityVer;
+	computeSeparability(integral, integralSq, separabilityHor, separabilityVer);
+	stageNs[stage_separability] += dt.nsecsElapsed();
+	if (wasCanceled())
+		return 0;
+
+	dt.restart();
+
+	double min, max;
+	cv::minMaxLoc(separabilityHor, &min, &max);	
+	cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, sepThr * max, dir_horizontal);
+	//cv::Mat edgeMapHor = computeEdgeMap(separabilityHor, 0.1, dir_horizontal);
+	if (wasCanceled())
+		return 0;
+
+	cv::minMaxLoc(separabilityVer, &min, &max);
+	cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, sepThr * max, dir_vertical);
+	//cv::Mat edgeMapVer = computeEdgeMap(separabilityVer, 0.1, dir_vertical);
+	stageNs[stage_edge_map] += dt.nsecsElapsed();
+	if (wasCanceled())
+		return 0;
+
+	selectedLines.clear();
+	selectedLineTypes.clear();
+
+	QVector<QVector3D> weightsHor = computeWeights(edgeMapHor, dir_horizontal);
+	qDebug() << weightsHor.size();
+	QVector<QVector3D> weightsVer = computeWeights(edgeMapVer, dir_vertical);
+	qDebug() << weightsVer.size();
+	if (wasCanceled()) {
+		selectedLines.clear();
+		selectedLineTypes.clear();
+		return 0;
 	}
-	else return 0;
+
+	weightsHor += weightsVer;
+
+	dt.restart();
+	double retAngle = computeSkewAngle(weightsHor, qSqrt(img.rows*img.rows + img.cols*img.cols));
+	stageNs[stage_saliency] += dt.nsecsElapsed();
+
+	if (scale != 1.0) {
+		for (int idx = 0; idx < selectedLines.size(); idx++)
+			selectedLines[idx] /= (float)scale;
+	}
+
+	return retAngle;
 }
 
-cv::Mat DkSkewEstimator::computeSeparability(cv::Mat integral, cv::Mat integralSq, int direction) {
+/**
+* Computes the horizontal and vertical separability maps in one pass.
+* The rows are split into bands which are processed in parallel. The GUI thread only polls
+* an atomic row counter to update the progress dialog (and to cancel the workers).
+* @param integral the integral image (CV_64F)
+* @param integralSq the squared integral image (CV_64F)
+* @param sepHor the horizontal separability (CV_32FC1)
+* @param sepVer the vertical separability (CV_32FC1)
+**/
+void DkSkewEstimator::computeSeparability(const cv::Mat& integral, const cv::Mat& integralSq, cv::Mat& sepHor, cv::Mat& sepVer) {
 
-	cv::Mat separability = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
+	sepHor = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
+	sepVer = cv::Mat::zeros(integral.rows, integral.cols, CV_32FC1);
 
 	int W2 = qCeil(sepDims.width()/2);
 	int H2 = qCeil(sepDims.height()/2);
+	int border = qCeil(delta/2);
 
-	if (direction == dir_horizontal) {
-		int progressStep = integral.rows - 2 * H2 - 2 * qCeil(delta/2);
-		int lastValue = progress->value();
+	QVector<QPair<int, int> > bands;
+	for (int r = 0; r < integral.rows; r += DK_SEP_BAND_HEIGHT)
+		bands << qMakePair(r, qMin(r + DK_SEP_BAND_HEIGHT, integral.rows));
 
-		for (int r = H2 + qCeil(delta/2); r < integral.rows - H2 - qCeil(delta/2); r++) {
-			progress->setValue(lastValue + qRound(30.0 * (r - H2 - qCeil(delta/2)) / (double)progressStep));
-			if (progress->wasCanceled()) break;
-			for (int c = W2 + qCeil(delta/2); c < integral.cols - W2 - qCeil(delta/2); c++) {
+	QAtomicInt rowsDone(0);
+	QAtomicInt canceled(0);
 
-				double mean1 = integral.at<double>(r - H2, c - W2) + integral.at<double>(r - 1, c + W2) - integral.at<double>(r - H2, c + W2) - integral.at<double>(r - 1, c - W2);
-				double mean2 = integral.at<double>(r + 1, c - W2) + integral.at<double>(r + H2, c + W2) - integral.at<double>(r + 1, c + W2) - integral.at<double>(r + H2, c - W2);
-				mean1 /= (2 * W2 * H2);
-				mean2 /= (2 * W2 * H2);
+	auto processBand = [&](const QPair<int, int>& band) {
 
-				double var1 = integralSq.at<double>(r - H2, c - W2) + integralSq.at<double>(r - 1, c + W2) - integralSq.at<double>(r - H2, c + W2) - integralSq.at<double>(r - 1, c - W2);
-				double var2 = integralSq.at<double>(r + 1, c - W2) + integralSq.at<double>(r + H2, c + W2) - integralSq.at<double>(r + 1, c + W2) - integralSq.at<double>(r + H2, c - W2);
-				var1 /= (2 * W2 * H2);
-				var2 /= (2 * W2 * H2);
+		if (canceled.load())
+			return;
 
-				var1 = var1 - (mean1 * mean1);
-				var2 = var2 - (mean2 * mean2);
+		separabilityRows(integral, integralSq, sepHor, sepVer, W2, H2, border, band.first, band.second);
+		rowsDone.fetchAndAddRelaxed(band.second - band.first);
+	};
 
-				separability.at<float>(r, c) = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
-			}
+	if (progress) {
+		QFuture<void> future = QtConcurrent::map(bands, processBand);
+		waitForFuture(future, rowsDone, integral.rows, 60, canceled);
+	}
+	else
+		QtConcurrent::blockingMap(bands, processBand);	// see waitForFuture
+
+	// for displaying:
+	// cv::normalize(separability, separability, 0, 255, NORM_MINMAX, CV_8UC1);
+	// cvtColor(separability, separability, CV_GRAY2RGB);
+}
+
+/**
+* Waits for parallel workers and updates the progress dialog meanwhile.
+* The workers never touch the GUI - they only count their finished items.
+* Without a progress dialog, QtConcurrent::blockingMap is used instead: the calling thread then processes
+* items too. Otherwise estimators that run in the global pool (batch processing) could wait forever for
+* jobs that are queued behind them.
+* @param future the running workers
+* @param done the number of finished items
+* @param total the number of items
+* @param range the progress range reserved for this stage
+* @param canceled is set if the user cancels, the workers should stop then
+**/
+void DkSkewEstimator::waitForFuture(QFuture<void>& future, const QAtomicInt& done, int total, int range, QAtomicInt& canceled) {
+
+	int lastValue = progressValue();
+
+	// throttled progress
+	while (!future.isFinished()) {
+
+		if (total > 0)
+			setProgressValue(lastValue + qRound((double)range * done.load() / total));
+
+		if (wasCanceled()) {
+			canceled.store(1);
+			future.cancel();
 		}
+
+		QThread::msleep(DK_PROGRESS_INTERVAL);
 	}
-	else {
-		int progressStep = integral.rows - 2 * W2 - 2 * qCeil(delta/2);
-		int lastValue = progress->value();
+	future.waitForFinished();
 
-		for (int r = W2 + qCeil(delta/2); r < integral.rows - W2 - qCeil(delta/2); r++) {
-			progress->setValue(lastValue + qRound(30.0 * (r - W2 - qCeil(delta/2)) / (double)progressStep));
-			if (progress->wasCanceled()) break;
+	if (!wasCanceled())
+		setProgressValue(lastValue + range);
+}
 
-			for (int c = H2 + qCeil(delta/2); c < integral.cols - H2 - qCeil(delta/2); c++) {
+/**
+* Computes both separability maps for the rows [firstRow lastRow).
+* The integral image rows are accessed with row pointers, so the inner loops run over contiguous memory
+* and can be vectorized by the compiler.
+**/
+void DkSkewEstimator::separabilityRows(const cv::Mat& integral, const cv::Mat& integralSq, cv::Mat& sepHor, cv::Mat& sepVer, 
+	int W2, int H2, int border, int firstRow, int lastRow) {
 
-				double mean1 = integral.at<double>(r - W2, c - H2) + integral.at<double>(r + W2, c - 1) - integral.at<double>(r + W2, c - H2) - integral.at<double>(r - W2, c - 1);
-				double mean2 = integral.at<double>(r - W2, c + 1) + integral.at<double>(r + W2, c + H2) - integral.at<double>(r + W2, c + 1) - integral.at<double>(r - W2, c + H2);
-				mean1 /= (2 * W2 * H2);
-				mean2 /= (2 * W2 * H2);
+	double invArea = 1.0 / (2 * W2 * H2);
 
-				double var1 = integralSq.at<double>(r - W2, c - H2) + integralSq.at<double>(r + W2, c - 1) - integralSq.at<double>(r + W2, c - H2) - integralSq.at<double>(r - W2, c - 1);
-				double var2 = integralSq.at<double>(r - W2, c + 1) + integralSq.at<double>(r + W2, c + H2) - integralSq.at<double>(r + W2, c + 1) - integralSq.at<double>(r - W2, c + H2);
-				var1 /= (2 * W2 * H2);
-				var2 /= (2 * W2 * H2);
+	for (int r = firstRow; r < lastRow; r++) {
 
-				var1 = var1 - (mean1 * mean1);
-				var2 = var2 - (mean2 * mean2);
+		// horizontal: the upper and the lower window are compared
+		if (r >= H2 + border && r < integral.rows - H2 - border) {
 
-				separability.at<float>(r, c) = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
+			const double* i0 = integral.ptr<double>(r - H2);
+			const double* i1 = integral.ptr<double>(r - 1);
+			const double* i2 = integral.ptr<double>(r + 1);
+			const double* i3 = integral.ptr<double>(r + H2);
+			const double* s0 = integralSq.ptr<double>(r - H2);
+			const double* s1 = integralSq.ptr<double>(r - 1);
+			const double* s2 = integralSq.ptr<double>(r + 1);
+			const double* s3 = integralSq.ptr<double>(r + H2);
+			float* dst = sepHor.ptr<float>(r);
+
+			for (int c = W2 + border; c < integral.cols - W2 - border; c++) {
+
+				double mean1 = (i0[c - W2] + i1[c + W2] - i0[c + W2] - i1[c - W2]) * invArea;
+				double mean2 = (i2[c - W2] + i3[c + W2] - i2[c + W2] - i3[c - W2]) * invArea;
+
+				double var1 = (s0[c - W2] + s1[c + W2] - s0[c + W2] - s1[c - W2]) * invArea - mean1 * mean1;
+				double var2 = (s2[c - W2] + s3[c + W2] - s2[c + W2] - s3[c - W2]) * invArea - mean2 * mean2;
+
+				dst[c] = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
 			}
 		}
-	}
 
-	// for displaying:
-	// cv::normalize(separability, separability, 0, 255, NORM_MINMAX, CV_8UC1);
-	// cvtColor(separability, separability, CV_GRAY2RGB);
+		// vertical: the left and the right window are compared
+		if (r >= W2 + border && r < integral.rows - W2 - border) {
+
+			const double* i0 = integral.ptr<double>(r - W2);
+			const double* i1 = integral.ptr<double>(r + W2);
+			const double* s0 = integralSq.ptr<double>(r - W2);
+			const double* s1 = integralSq.ptr<double>(r + W2);
+			float* dst = sepVer.ptr<float>(r);
 
-	return separability;
+			for (int c = H2 + border; c < integral.cols - H2 - border; c++) {
+
+				double mean1 = (i0[c - H2] + i1[c - 1] - i1[c - H2] - i0[c - 1]) * invArea;
+				double mean2 = (i0[c + 1] + i1[c + H2] - i1[c + 1] - i0[c + H2]) * invArea;
+
+				double var1 = (s0[c - H2] + s1[c - 1] - s1[c - H2] - s0[c - 1]) * invArea - mean1 * mean1;
+				double var2 = (s0[c + 1] + s1[c + H2] - s1[c + 1] - s0[c + H2]) * invArea - mean2 * mean2;
+
+				dst[c] = (float)((mean1 - mean2) * (mean1 - mean2) / (var1 + var2));
+			}
+		}
+	}
 }
 
 cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int direction) {
@@ -233,12 +444,12 @@ cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int di
 
 	if (direction == dir_horizontal) {
 		int progressStep = separability.rows - 2 * H2 - 2 * kMax;
-		int lastValue = progress->value();
+		int lastValue = progressValue();
 
 		float* p;
 		for (int r = H2 + kMax; r < separability.rows - H2 - kMax; r++) {
-			progress->setValue(lastValue + qRound(5.0 * (r - H2 - kMax) / (double)progressStep));
-			if (progress->wasCanceled()) break;
+			setProgressValue(lastValue + qRound(5.0 * (r - H2 - kMax) / (double)progressStep));
+			if (wasCanceled()) break;
 
 			p = separability.ptr<float>(r);
 			for (int c = W2; c < separability.cols - W2; c++) {
@@ -266,12 +477,12 @@ cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int di
 	}
 	else  {
 		int progressStep = separability.rows - 2 * W2 - 2 * kMax;
-		int lastValue = progress->value();
+		int lastValue = progressValue();
 
 		float* p;
 		for (int r = W2; r < separability.rows - W2; r++) {
-			progress->setValue(lastValue + qRound(5.0 * (r - W2 - kMax) / (double)progressStep));
-			if (progress->wasCanceled()) break;
+			setProgressValue(lastValue + qRound(5.0 * (r - W2 - kMax) / (double)progressStep));
+			if (wasCanceled()) break;
 
 			p = separability.ptr<float>(r);
 			for (int c = H2 + kMax; c < separability.cols - H2 - kMax; c++) {
@@ -299,162 +510,197 @@ cv::Mat DkSkewEstimator::computeEdgeMap(cv::Mat separability, double thr, int di
 	return edgeMap;
 }
 
+/**
+* Lines far outside the angle range cannot contribute to the saliency (3 sigma).
+* @param angle the line angle in radians
+**/
+bool DkSkewEstimator::isInAngleRange(double angle) const {
+
+	double deg = angle / M_PI * 180;
+	return deg >= minAngle - 3*sigma && deg <= maxAngle + 3*sigma;
+}
+
 int DkSkewEstimator::randInt(int low, int high) {
 
 	return qrand() % ((high + 1) - low) + low;
 }
 
+/**
+* Scores all Hough lines of an edge map in parallel.
+* The lines are split into chunks, each chunk reuses one scratch buffer for the prefix sums.
+* @param edgeMap the binary edge map
+* @param direction dir_horizontal or dir_vertical
+* @return the weights (score, angle, distance to the center) of all lines that have edge support
+**/
 QVector<QVector3D> DkSkewEstimator::computeWeights(cv::Mat edgeMap, int direction) {
 
+	QElapsedTimer dt;
+	dt.start();
+
 	std::vector<cv::Vec4i> lines;
-	QVector4D maxLine = QVector4D();
 	HoughLinesP(edgeMap, lines, 1, CV_PI/180, 50, minLineLength, 20 ); //params: rho resolution, theta resolution, threshold, min Line length, max line gap
+	stageNs[stage_hough] += dt.nsecsElapsed();
+	dt.restart();
 
-	QVector<QVector3D> computedWeights = QVector<QVector3D>();
-	int lastValue = progress->value();
+	int numLines = (int)lines.size();
+	QVector<QVector3D> lineWeights(numLines);
+	QVector<QVector4D> lineCoords(numLines);
+	QVector3D* wPtr = lineWeights.data();
+	QVector4D* lPtr = lineCoords.data();
 
-	for(size_t i = 0; i < lines.size(); i++) {
-		progress->setValue(lastValue + qRound(15.0 * (float)i / lines.size()));
-		if (progress->wasCanceled()) break;
+	QVector<QPair<int, int> > chunks;
+	for (int i = 0; i < numLines; i += DK_WEIGHT_CHUNK)
+		chunks << qMakePair(i, qMin(i + DK_WEIGHT_CHUNK, numLines));
 
-		cv::Vec4i l = lines[i];		
-		QVector3D currMax = QVector3D(0.0, 0.0, 0.0);
+	QAtomicInt linesDone(0);
+	QAtomicInt canceled(0);
 
-		if (direction == dir_horizontal) {
+	auto scoreChunk = [&](const QPair<int, int>& chunk) {
 
-			int K = 0;
+		std::vector<double> prefix;	// scratch buffer shared by all lines of this chunk
 
-			if (l[2] < l[0]) l = cv::Vec4i(l[2],l[3],l[0],l[1]);
+		for (int i = chunk.first; i < chunk.second; i++) {
 
-			int x1 = l[0];
-			int x2 = l[2];
+			if (canceled.load())
+				return;
 
-			while(x2 > edgeMap.cols) x2--;
-			while(x1 < 0) x1--;
+			scoreLine(edgeMap, lines[i], direction, prefix, wPtr[i], lPtr[i]);
+		}
 
-			double lineAngle =  atan2((l[3] - l[1]), (l[2] - l[0]));
-			double slope = qTan(lineAngle);
+		linesDone.fetchAndAddRelaxed(chunk.second - chunk.first);
+	};
 
-			while (qAbs(x1-x2) > minLineProjLength && K < nIter) {
+	if (progress) {
+		QFuture<void> future = QtConcurrent::map(chunks, scoreChunk);
+		waitForFuture(future, linesDone, numLines, 15, canceled);
+	}
+	else
+		QtConcurrent::blockingMap(chunks, scoreChunk);
 
-				int y1 = qRound(l[1] + (x1 - l[0]) * slope);
-				int y2 = qRound(l[1] + (x2 - l[0]) * slope);
+	// compact in the line order so that the result does not depend on the thread scheduling
+	QVector<QVector3D> computedWeights = QVector<QVector3D>();
 
-				QVector<int> yrPoss1 = QVector<int>();
-				for (int di = -delta; di <= delta && y1 + di < edgeMap.rows; di++) {
-					if (y1 + di >= 0)
-						if (edgeMap.at<uchar>(y1 + di, x1) == 1) yrPoss1.append(y1+di);
-				}
-				
-				QVector<int> yrPoss2 = QVector<int>();
-				for (int di = -delta; di <= delta && y2 + di < edgeMap.rows; di++) {
-					if (y2 + di >= 0)
-						if (edgeMap.at<uchar>(y2 + di, x2) == 1) yrPoss2.append(y2+di);
-				}
+	for (int i = 0; i < numLines && !canceled.load(); i++) {
 
-				if (yrPoss1.size() > 0 && yrPoss2.size() > 0) {
-					for (int y1i = 0; y1i < yrPoss1.size(); y1i++) {
+		if (lineWeights[i].x() > 0) {
+			computedWeights.append(lineWeights[i]);
+			selectedLines.append(lineCoords[i]);
+			selectedLineTypes.append(0);
+		}
+	}
 
-						int ys1 = yrPoss1.at(y1i);
-						for (int y2i = 0; y2i < yrPoss2.size(); y2i++) {
-							int ys2 = yrPoss2.at(y2i);
+	stageNs[stage_weights] += dt.nsecsElapsed();
 
-							double sumVal = 0;
-							for (int xi = x1; xi <= x2; xi++)
-								for (int yi = -epsilon; yi <= epsilon; yi++) {
-									int yc = qRound(l[1] + (xi - l[0]) * slope) + yi;
-									if(yc < edgeMap.rows && xi < edgeMap.cols && yc > 0 && xi > 0) sumVal += edgeMap.at<uchar>(yc, xi);
-								}
+	return computedWeights;
+}
 
-							if (sumVal > currMax.x()) {
-				
-								QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
-								currMax = QVector3D(sumVal, - rotationFactor * lineAngle, (float) qSqrt( (edgeMap.cols*0.5 - centerPoint.x()) * (edgeMap.cols*0.5 - centerPoint.x()) + (edgeMap.rows*0.5 - centerPoint.y()) * (edgeMap.rows*0.5 - centerPoint.y()) ));
-								maxLine = QVector4D(x1, y1, x2, y2);
-							}
+/**
+* Finds the best supported segment of a Hough line and scores it.
+* The line is parametrized along its main direction (u) with the offset (v) across it.
+* Edge pixels along the line are summed once into a prefix sum, so that each candidate
+* segment [x1 x2] is scored in O(1).
+* @param edgeMap the binary edge map
+* @param l the Hough line
+* @param direction dir_horizontal or dir_vertical
+* @param prefix scratch buffer for the prefix sums
+* @param weight the score, angle and distance to the center (score is 0 if the line has no support)
+* @param line the selected segment in image coordinates
+**/
+void DkSkewEstimator::scoreLine(const cv::Mat& edgeMap, const cv::Vec4i& l, int direction, std::vector<double>& prefix, QVector3D& weight, QVector4D& line) const {
+
+	bool vertical = direction == dir_vertical;
+
+	// (u0,v0) -> (u1,v1) in line coordinates
+	int u0 = vertical ? l[1] : l[0];
+	int v0 = vertical ? l[0] : l[1];
+	int u1 = vertical ? l[3] : l[2];
+	int v1 = vertical ? l[2] : l[3];
+
+	if (u1 < u0) {
+		qSwap(u0, u1);
+		qSwap(v0, v1);
+	}
 
-							K++;
-						}
-					}
-				}
+	int lenU = vertical ? edgeMap.rows : edgeMap.cols;
+	int lenV = vertical ? edgeMap.cols : edgeMap.rows;
 
-				x1++;
-				x2--;				
-			}
-		}
-		else {
+	weight = QVector3D(0.0, 0.0, 0.0);
 
-			int K = 0;
-			if (l[3] < l[1]) l = cv::Vec4i(l[2],l[3],l[0],l[1]);
+	double lineAngle = atan2((double)(v1 - v0), (double)(u1 - u0));
+	double angle = vertical ? rotationFactor * lineAngle : -rotationFactor * lineAngle;
 
-			int x1 = l[1];
-			int x2 = l[3];
+	if (!isInAngleRange(angle))
+		return;
 
-			while(x2 > edgeMap.rows) x2--;
-			while(x1 < 0) x1--;
+	double slope = qTan(lineAngle);
 
-			double lineAngle =  atan2((l[2] - l[0]), (l[3] - l[1]));
-			double slope = qTan(lineAngle);
-			
+	int x1 = qMax(u0, 0);
+	int x2 = qMin(u1, lenU - 1);
 
-			while (qAbs(x1-x2) > minLineProjLength && K < nIter) {
+	if (x2 < x1)
+		return;
 
-				int y1 = qRound(l[0] + (x1 - l[1]) * slope);
-				int y2 = qRound(l[0] + (x2 - l[1]) * slope);
+	auto edgeAt = [&](int u, int v) -> uchar {
+		return vertical ? edgeMap.at<uchar>(u, v) : edgeMap.at<uchar>(v, u);
+	};
 
-				QVector<int> yrPoss1 = QVector<int>();
-				for (int di = -delta; di <= delta && y1 + di < edgeMap.cols; di++) {
-					if (y1 + di >= 0)
-						if (edgeMap.at<uchar>(x1, y1 + di) == 1) yrPoss1.append(y1+di);
-				}
-				
-				QVector<int> yrPoss2 = QVector<int>();
-				for (int di = -delta; di <= delta && y2 + di < edgeMap.cols; di++) {
-					if (y2 + di >= 0)
-						if (edgeMap.at<uchar>(x2, y2 + di) == 1) yrPoss2.append(y2+di);
-				}
+	// prefix[i+1] - prefix[x1] = edge pixels within +/- epsilon of the line in [x1 i]
+	prefix.resize(x2 - x1 + 2);
+	prefix[0] = 0;
+	for (int xi = x1; xi <= x2; xi++) {
 
-				if (yrPoss1.size() > 0 && yrPoss2.size() > 0) {
-					for (int y1i = 0; y1i < yrPoss1.size(); y1i++) {
+		double colSum = 0;
+		int yl = qRound(v0 + (xi - u0) * slope);
 
-						int ys1 = yrPoss1.at(y1i);
-						for (int y2i = 0; y2i < yrPoss2.size(); y2i++) {
-							int ys2 = yrPoss2.at(y2i);
+		if (xi > 0) {
+			for (int yc = qMax(yl - epsilon, 1); yc <= yl + epsilon && yc < lenV; yc++)
+				colSum += edgeAt(xi, yc);
+		}
 
-							double sumVal = 0;
-							for (int xi = x1; xi <= x2; xi++)
-								for (int yi = -epsilon; yi <= epsilon; yi++) {
-									int yc = qRound(l[0] + (xi - l[1]) * slope) + yi;
-									if(yc < edgeMap.cols && xi < edgeMap.rows && yc > 0 && xi > 0) sumVal += edgeMap.at<uchar>(xi, yc);
-								}
+		prefix[xi - x1 + 1] = prefix[xi - x1] + colSum;
+	}
 
-							if (sumVal > currMax.x()) {
-				
-								QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
-								currMax = QVector3D(sumVal, rotationFactor * lineAngle, (float) qSqrt( (edgeMap.rows *0.5 - centerPoint.x()) * (edgeMap.rows*0.5 - centerPoint.x()) + (edgeMap.cols*0.5 - centerPoint.y()) * (edgeMap.cols*0.5 - centerPoint.y()) ));
-								maxLine = QVector4D(y1, x1, y2, x2);
-							}
+	// number of edge pixels within +/- delta of the line at column x
+	auto support = [&](int x, int y) -> int {
+		int cnt = 0;
+		for (int yc = qMax(y - delta, 0); yc <= y + delta && yc < lenV; yc++)
+			if (edgeAt(x, yc) == 1) cnt++;
+		return cnt;
+	};
 
-							K++;
-						}
-					}
-				}
+	int xStart = x1;
+	int K = 0;
+
+	while (qAbs(x1-x2) > minLineProjLength && K < nIter) {
 
-				x1++;
-				x2--;				
+		int y1 = qRound(v0 + (x1 - u0) * slope);
+		int y2 = qRound(v0 + (x2 - u0) * slope);
+
+		int n1 = support(x1, y1);
+		int n2 = (n1 > 0) ? support(x2, y2) : 0;
+
+		if (n1 > 0 && n2 > 0) {
+
+			double sumVal = prefix[x2 - xStart + 1] - prefix[x1 - xStart];
+
+			if (sumVal > weight.x()) {
+
+				QPointF centerPoint = QPointF(0.5*(x1 + x2), 0.5*(y1 + y2));
+				weight = QVector3D(sumVal, angle, (float) qSqrt( (lenU*0.5 - centerPoint.x()) * (lenU*0.5 - centerPoint.x()) + (lenV*0.5 - centerPoint.y()) * (lenV*0.5 - centerPoint.y()) ));
+				line = vertical ? QVector4D(y1, x1, y2, x2) : QVector4D(x1, y1, x2, y2);
 			}
-		}
 
-		if (currMax.x() > 0) {
-			computedWeights.append(currMax);
-			if (rotationFactor == -1) maxLine = QVector4D(maxLine.y(), maxLine.x(), maxLine.w(), maxLine.z());
-			selectedLines.append(maxLine);
-			selectedLineTypes.append(0);
+			// each candidate pair of the original formulation counts as one iteration
+			K += n1 * n2;
 		}
+
+		x1++;
+		x2--;
 	}
-	return computedWeights;
-}
 
+	if (weight.x() > 0 && rotationFactor == -1) 
+		line = QVector4D(line.y(), line.x(), line.w(), line.z());
+}
 
 double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal) {
 
@@ -474,28 +720,40 @@ double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgD
 			//thrWeights.append(QVector3D((weights.at(i).x()/maxWeight - eta) * (weights.at(i).x()/maxWeight - eta), weights.at(i).y() / M_PI * 180, weights.at(i).z() / imgDiagonal));
 		}
 
-	QVector<QPointF> saliencyVec = QVector<QPointF>();
+	// kernel density estimate: each line votes once into a fine angle histogram
+	// which is then convolved with a sampled Gaussian at every candidate angle
+	int kernelRadius = qCeil(4.0 * sigma / DK_SALIENCY_BIN);
+	double histStart = minAngle - kernelRadius * DK_SALIENCY_BIN;
+	int numBins = qRound((maxAngle - minAngle) / DK_SALIENCY_BIN) + 2 * kernelRadius + 1;
 
-	for (double skewAngle = -30; skewAngle <= 30.001; skewAngle += 0.1) {
+	QVector<double> hist = angleHistogram(thrWeights, histStart, numBins);
 
-		double saliency = 0;
-
-		for (int i = 0; i < thrWeights.size(); i++) {
-			saliency += thrWeights.at(i).x() * qExp(-thrWeights.at(i).z()) * qExp(-0.5 * ((skewAngle - thrWeights.at(i).y()) * (skewAngle - thrWeights.at(i).y())) / (sigma * sigma));
-		}
-
-		saliencyVec.append(QPointF(skewAngle, saliency));
+	QVector<double> kernel(2 * kernelRadius + 1);
+	for (int k = -kernelRadius; k <= kernelRadius; k++) {
+		double a = k * DK_SALIENCY_BIN;
+		kernel[k + kernelRadius] = qExp(-0.5 * a * a / (sigma * sigma));
 	}
 
-	//for (int i = 0; i < saliencyVec.size(); i++) qDebug() << saliencyVec.at(i);
+	int step = qRound(DK_SALIENCY_STEP / DK_SALIENCY_BIN);
+	int numAngles = qFloor((maxAngle - minAngle) / DK_SALIENCY_STEP + 0.01) + 1;
+	const double* hPtr = hist.constData();
+	const double* kPtr = kernel.constData();
 
 	double maxSaliency = 0;
 	double salSkewAngle = 0;
 
-	for (int i = 0; i < saliencyVec.size(); i++)  {
-		if (maxSaliency < saliencyVec.at(i).y()) {
-			maxSaliency = saliencyVec.at(i).y();
-			salSkewAngle = saliencyVec.at(i).x();
+	for (int idx = 0; idx < numAngles; idx++) {
+
+		// the histogram is padded with kernelRadius bins on both sides
+		const double* h = hPtr + idx * step;
+		double saliency = 0;
+
+		for (int k = 0; k < kernel.size(); k++)
+			saliency += h[k] * kPtr[k];
+
+		if (maxSaliency < saliency) {
+			maxSaliency = saliency;
+			salSkewAngle = minAngle + idx * DK_SALIENCY_STEP;
 		}
 	}
 
@@ -508,6 +766,72 @@ double DkSkewEstimator::computeSkewAngle(QVector<QVector3D> weights, double imgD
 	return salSkewAngle;
 }
 
+int DkSkewEstimator::progressValue() const {
+
+	return (progress) ? progress->value() : progressSteps;
+}
+
+void DkSkewEstimator::setProgressValue(int value) {
+
+	progressSteps = value;
+
+	if (progress)
+		progress->setValue(value);
+}
+
+bool DkSkewEstimator::wasCanceled() const {
+
+	return progress && progress->wasCanceled();
+}
+
+/**
+* Accumulates the weighted line angles into a histogram.
+* Each line adds weight * exp(-distance) to the bin of its angle.
+* Large line sets are split into chunks that are accumulated in parallel.
+* @param weights the thresholded weights (weight, angle in degrees, normalized distance to the center)
+* @param histStart the angle of the first bin (degrees)
+* @param numBins the number of bins - each bin is DK_SALIENCY_BIN degrees wide
+**/
+QVector<double> DkSkewEstimator::angleHistogram(const QVector<QVector3D>& weights, double histStart, int numBins) const {
+
+	QVector<QPair<int, int> > chunks;
+	for (int i = 0; i < weights.size(); i += DK_SALIENCY_CHUNK)
+		chunks << qMakePair(i, qMin(i + DK_SALIENCY_CHUNK, weights.size()));
+
+	QVector<QVector<double> > partials(chunks.size());
+
+	auto accumulate = [&](const QPair<int, int>& chunk) {
+
+		QVector<double> h(numBins, 0.0);
+		double* hPtr = h.data();
+
+		for (int i = chunk.first; i < chunk.second; i++) {
+
+			const QVector3D& w = weights.at(i);
+			int bin = qRound((w.y() - histStart) / DK_SALIENCY_BIN);
+
+			// lines outside the padded range do not contribute
+			if (bin >= 0 && bin < numBins)
+				hPtr[bin] += w.x() * qExp(-w.z());
+		}
+
+		partials[chunk.first / DK_SALIENCY_CHUNK] = h;
+	};
+
+	if (chunks.size() > 1)
+		QtConcurrent::blockingMap(chunks, accumulate);
+	else if (!chunks.isEmpty())
+		accumulate(chunks.first());
+
+	QVector<double> hist(numBins, 0.0);
+	for (const QVector<double>& h : partials) {
+		for (int b = 0; b < numBins; b++)
+			hist[b] += h[b];
+	}
+
+	return hist;
+}
+
 QVector<QVector4D> DkSkewEstimator::getLines() {
 
 	return selectedLines;
@@ -36,6 +36,10 @@
 #include <QProgressDialog>
 #include <QWidget>
 #include <QDebug>
+#include <QFuture>
+#include <QAtomicInt>
+
+#include <vector>
 
 // opencv
 #ifdef WITH_OPENCV
@@ -64,6 +68,17 @@ public:
 		dir_end,
 	};
 
+	// stages of the last getSkewAngle() call that are timed
+	enum {
+		stage_separability = 0,
+		stage_edge_map,
+		stage_hough,
+		stage_weights,
+		stage_saliency,
+
+		stage_end,
+	};
+
 	DkSkewEstimator(QWidget* mainWin = 0);
 	~DkSkewEstimator();
 
@@ -71,12 +86,26 @@ public:
 	QVector<QVector4D> getLines();
 	QVector<int> getLineTypes();
 	void setImage(QImage inImage);
+	void setCoarseToFine(bool enabled);
+	QVector<double> stageTimes() const;
 
 private: 
-	cv::Mat computeSeparability(cv::Mat integral, cv::Mat integralSq, int direction);
+	double estimateAngle(const cv::Mat& img, double scale, double fromAngle, double toAngle);
+	void setParameters(const QSize& size);
+	int coarseLevel() const;
+	void computeSeparability(const cv::Mat& integral, const cv::Mat& integralSq, cv::Mat& sepHor, cv::Mat& sepVer);
+	static void separabilityRows(const cv::Mat& integral, const cv::Mat& integralSq, cv::Mat& sepHor, cv::Mat& sepVer, 
+		int W2, int H2, int border, int firstRow, int lastRow);
 	cv::Mat computeEdgeMap(cv::Mat separability, double thr, int direction);
 	QVector<QVector3D> computeWeights(cv::Mat edgeMap, int direction);
+	void scoreLine(const cv::Mat& edgeMap, const cv::Vec4i& l, int direction, std::vector<double>& prefix, QVector3D& weight, QVector4D& line) const;
+	int progressValue() const;
+	void setProgressValue(int value);
+	bool wasCanceled() const;
+	void waitForFuture(QFuture<void>& future, const QAtomicInt& done, int total, int range, QAtomicInt& canceled);
 	double computeSkewAngle(QVector<QVector3D> weights, double imgDiagonal);
+	QVector<double> angleHistogram(const QVector<QVector3D>& weights, double histStart, int numBins) const;
+	bool isInAngleRange(double angle) const;
 	int randInt(int low, int high);
 
 	int nIter;
@@ -88,13 +117,19 @@ private:
 	int kMax;
 	int minLineLength;
 	int minLineProjLength;
+	double minAngle;			// search range of the skew angle in degrees
+	double maxAngle;
+	bool coarseToFine;
 	
 	QVector<QVector4D> selectedLines;
 	QVector<int> selectedLineTypes;
 	cv::Mat matImg;
+	QSize imgSize;
 	int rotationFactor;
-	QProgressDialog* progress;
+	QProgressDialog* progress;	// 0 if no main window is set
+	int progressSteps;
 	QWidget* mainWin;
+	QVector<qint64> stageNs;	// accumulated over all pyramid levels
 };
 
 };
@@ -0,0 +1,198 @@
+/*******************************************************************************************************
+ DkTransformStack.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkTransformStack.h"
+
+namespace nmp {
+
+/*-----------------------------------DkTransformStack ---------------------------------------------*/
+
+DkTransformStack::DkTransformStack() {
+
+	scaleValues = QPointF(1,1);
+	shearValues = QPointF(0,0);
+	rotationValue = 0;
+	crop = false;
+}
+
+void DkTransformStack::setScale(const QPointF& scale) {
+	scaleValues = scale;
+}
+
+void DkTransformStack::setShear(const QPointF& shear) {
+	shearValues = shear;
+}
+
+void DkTransformStack::setRotation(double angle) {
+	rotationValue = angle;
+}
+
+void DkTransformStack::setCropEnabled(bool crop) {
+	this->crop = crop;
+}
+
+QPointF DkTransformStack::scale() const {
+	return scaleValues;
+}
+
+QPointF DkTransformStack::shear() const {
+	return shearValues;
+}
+
+double DkTransformStack::rotation() const {
+	return rotationValue;
+}
+
+bool DkTransformStack::cropEnabled() const {
+	return crop;
+}
+
+bool DkTransformStack::isIdentity() const {
+
+	return linearTransform().isIdentity();
+}
+
+/**
+* @return scale, shear and rotation composed (without translation)
+**/
+QTransform DkTransformStack::linearTransform() const {
+
+	// QTransform applies the last operation first
+	QTransform affineTransform = QTransform();
+	affineTransform.rotate(rotationValue);
+	affineTransform.shear(shearValues.x(), shearValues.y());
+	affineTransform.scale(scaleValues.x(), scaleValues.y());
+
+	return affineTransform;
+}
+
+/**
+* Computes the transformation that maps image coordinates to the result.
+* @param imgSize the size of the image
+* @param dstSize returns the size of the result - this is the crop rectangle if cropping is possible
+* @return the transformation for DkAffineWarp::warp
+**/
+QTransform DkTransformStack::transform(const QSize& imgSize, QSize& dstSize) const {
+
+	QTransform affineTransform = linearTransform();
+	dstSize = affineTransform.mapRect(QRectF(QPointF(), QSizeF(imgSize))).size().toSize();
+
+	// only the pixels inside the crop rectangle are computed
+	QSize cs = cropSize(imgSize);
+	if (!cs.isEmpty())
+		dstSize = cs;
+
+	return QTransform::fromTranslate(-0.5*imgSize.width(), -0.5*imgSize.height()) * affineTransform * 
+		QTransform::fromTranslate(0.5*dstSize.width(), 0.5*dstSize.height());
+}
+
+/**
+* Returns the axis parallel rectangle (centered) whose corners touch the edges of the transformed image.
+* For a pure rotation this is the largest rectangle that does not contain any background.
+* @param imgSize the size of the image
+* @return the crop size or an empty size if cropping is disabled or not possible
+**/
+QSize DkTransformStack::cropSize(const QSize& imgSize) const {
+
+	if (!crop)
+		return QSize();
+
+	// the transformed image is a parallelogram spanned by e1 and e2 (from its center)
+	QTransform affineTransform = linearTransform();
+	QPointF e1 = affineTransform.map(QPointF(0.5*imgSize.width(), 0));
+	QPointF e2 = affineTransform.map(QPointF(0, 0.5*imgSize.height()));
+
+	// edge normals & distances: the edges parallel to e2 are at +/- e1 and vice versa
+	QPointF n1(-e2.y(), e2.x());
+	QPointF n2(-e1.y(), e1.x());
+	double d1 = qAbs(n1.x()*e1.x() + n1.y()*e1.y());
+	double d2 = qAbs(n2.x()*e2.x() + n2.y()*e2.y());
+
+	// the corner (x,y) touches both edges: |n.x|*x + |n.y|*y = d
+	double a1 = qAbs(n1.x()), b1 = qAbs(n1.y());
+	double a2 = qAbs(n2.x()), b2 = qAbs(n2.y());
+	double det = a1*b2 - b1*a2;
+
+	if (qAbs(det) < 1e-10)
+		return QSize();
+
+	double x = (d1*b2 - b1*d2) / det;
+	double y = (a1*d2 - d1*a2) / det;
+
+	QSize bbSize = affineTransform.mapRect(QRectF(QPointF(), QSizeF(imgSize))).size().toSize();
+	QSize cropSize(qRound(2*x), qRound(2*y));
+
+	if (cropSize.isEmpty() || cropSize.width() > bbSize.width() || cropSize.height() > bbSize.height())
+		return QSize();
+
+	return cropSize;
+}
+
+/**
+* Transforms the image with a single resampling pass.
+* The background is filled with white.
+* This function is thread-safe.
+* @param img the image
+* @param interpolation the DkAffineWarp interpolation
+**/
+QImage DkTransformStack::apply(const QImage& img, int interpolation) const {
+
+	if (isIdentity())
+		return img;
+
+	QSize dstSize;
+	QTransform affineTransform = transform(img.size(), dstSize);
+
+	return DkAffineWarp::warp(img, affineTransform, dstSize, interpolation);
+}
+
+void DkTransformStack::loadSettings(QSettings& settings) {
+
+	settings.beginGroup("affineTransformPlugin");
+	scaleValues.setX(settings.value("scaleX", scaleValues.x()).toDouble());
+	scaleValues.setY(settings.value("scaleY", scaleValues.y()).toDouble());
+	shearValues.setX(settings.value("shearX", shearValues.x()).toDouble());
+	shearValues.setY(settings.value("shearY", shearValues.y()).toDouble());
+	rotationValue = settings.value("rotation", rotationValue).toDouble();
+	crop = (settings.value("cropEnabled", (crop) ? Qt::Checked : Qt::Unchecked).toInt() == Qt::Checked);
+	settings.endGroup();
+}
+
+void DkTransformStack::saveSettings(QSettings& settings) const {
+
+	settings.beginGroup("affineTransformPlugin");
+	settings.setValue("scaleX", scaleValues.x());
+	settings.setValue("scaleY", scaleValues.y());
+	settings.setValue("shearX", shearValues.x());
+	settings.setValue("shearY", shearValues.y());
+	settings.setValue("rotation", rotationValue);
+	settings.setValue("cropEnabled", (crop) ? Qt::Checked : Qt::Unchecked);
+	settings.endGroup();
+}
+
+};
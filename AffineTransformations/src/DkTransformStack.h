@@ -0,0 +1,77 @@
+/*******************************************************************************************************
+ DkTransformStack.h
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#pragma once
+
+#include <QImage>
+#include <QTransform>
+#include <QPointF>
+#include <QSize>
+#include <QSettings>
+
+#include "DkAffineWarp.h"
+
+namespace nmp {
+
+/**
+* Scale, shear, rotation and crop composed into a single affine transformation.
+* The operations are applied in this order around the image center, so the image is resampled only once.
+* It is shared by the viewport and the batch actions.
+**/
+class DkTransformStack {
+
+public:
+	DkTransformStack();
+
+	void setScale(const QPointF& scale);
+	void setShear(const QPointF& shear);
+	void setRotation(double angle);
+	void setCropEnabled(bool crop);
+
+	QPointF scale() const;
+	QPointF shear() const;
+	double rotation() const;
+	bool cropEnabled() const;
+	bool isIdentity() const;
+
+	QTransform linearTransform() const;
+	QTransform transform(const QSize& imgSize, QSize& dstSize) const;
+	QSize cropSize(const QSize& imgSize) const;
+	QImage apply(const QImage& img, int interpolation = DkAffineWarp::interp_bicubic) const;
+
+	void loadSettings(QSettings& settings);
+	void saveSettings(QSettings& settings) const;
+
+protected:
+	QPointF scaleValues;
+	QPointF shearValues;
+	double rotationValue;	// in degrees
+	bool crop;
+};
+
+};
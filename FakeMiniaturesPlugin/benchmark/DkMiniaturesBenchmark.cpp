@@ -0,0 +1,344 @@
+/*******************************************************************************************************
+ DkMiniaturesBenchmark.cpp
+ Created on:	19.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMiniaturesBenchmark.h"
+#include "DkMiniaturesFilter.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QtCore/qmath.h>
+
+#include <cmath>
+
+#ifdef WITH_OPENCV
+#include "opencv2/imgproc/imgproc.hpp"
+#endif
+
+namespace nmp {
+
+/**
+* Verifies the kernels and measures the filter.
+* @param maxMegaPixels the largest benchmark image (up to 100 megapixels)
+* @param iterations the number of runs per measurement
+* @return true if all kernels match the reference
+**/
+bool DkMiniaturesBenchmark::run(int maxMegaPixels, int iterations) {
+
+	bool ok = true;
+
+#ifdef WITH_OPENCV
+	ok = verify();
+	qDebug() << "[Miniatures Benchmark] kernels" << (ok ? "match" : "do NOT match") << "the reference";
+#endif
+
+	QVector<int> megaPixels;
+	megaPixels << 1 << 4 << 16 << 36 << 64 << 100;
+
+	QVector<int> kernelSizes;
+	kernelSizes << 5 << 35 << 70 << 140;
+
+	QVector<int> threads;
+	for (int n = 1; n < QThread::idealThreadCount(); n *= 2)
+		threads << n;
+	threads << qMax(QThread::idealThreadCount(), 1);
+
+	int defaultThreads = QThreadPool::globalInstance()->maxThreadCount();
+
+	for (int mIdx = 0; mIdx < megaPixels.size() && megaPixels[mIdx] <= maxMegaPixels; mIdx++) {
+
+		// 3:2 like most cameras
+		int width = qRound(qSqrt(megaPixels[mIdx] * 1.5e6));
+		QImage img = createImage(width, qRound(width / 1.5));
+		int memory = DkMiniaturesFilter::memoryUsage(img.size(), img.depth());
+
+		for (int kIdx = 0; kIdx < kernelSizes.size(); kIdx++) {
+			for (int mode = DkMiniaturesFilter::blur_box; mode < DkMiniaturesFilter::blur_end; mode++) {
+				for (int tIdx = 0; tIdx < threads.size(); tIdx++) {
+
+					double ms = milliSeconds(img, kernelSizes[kIdx], mode, threads[tIdx], iterations);
+					double mps = (ms > 0) ? img.width() * (double)img.height() / (ms * 1e3) : 0.0;
+
+					qDebug().nospace() << "[Miniatures Benchmark] " << img.width() << "x" << img.height() 
+						<< (mode == DkMiniaturesFilter::blur_bokeh ? " bokeh" : " box") 
+						<< " kernel " << kernelSizes[kIdx] << " " << threads[tIdx] << " thread(s): " 
+						<< ms << " ms " << mps << " MPixel/s ~" << memory << " MB";
+				}
+			}
+		}
+	}
+
+	QThreadPool::globalInstance()->setMaxThreadCount(defaultThreads);
+
+	return ok;
+}
+
+/**
+* Measures the filter with a centered focus band.
+* The filter uses the global thread pool, hence its thread count is changed
+* (which is why the benchmark runs in its own process and not in the plugin).
+* @param img the input image
+* @param kernelSize the maximal kernel size
+* @param blurMode DkMiniaturesFilter::blur_box | DkMiniaturesFilter::blur_bokeh
+* @param numThreads the number of threads
+* @param iterations the number of runs (the fastest run is reported)
+* @return the run time in milliseconds
+**/
+double DkMiniaturesBenchmark::milliSeconds(const QImage& img, int kernelSize, int blurMode, int numThreads, int iterations) {
+
+	if (img.isNull() || numThreads < 1)
+		return 0.0;
+
+	QThreadPool::globalInstance()->setMaxThreadCount(numThreads);
+
+	DkMiniaturesParams params;
+	params.maxKernel = kernelSize;
+	params.blurMode = blurMode;
+
+	QImage dst;
+	qint64 best = -1;
+
+	for (int it = 0; it < iterations; it++) {
+
+		QElapsedTimer dt;
+		dt.start();
+
+		// the output is reused - like the preview does
+		DkMiniaturesFilter::apply(img, dst, params.focusModel(img.size()), params.kernelSize(img.size()), params.saturation, 0, blurMode);
+
+		qint64 ns = dt.nsecsElapsed();
+		if (best < 0 || ns < best)
+			best = ns;
+	}
+
+	return best * 1e-6;
+}
+
+/**
+* Creates a synthetic image with gradients, a fine texture and a grid of highlights.
+* The highlights make the bokeh blur boost them - as it would for lights in a photo.
+* @param width the image width
+* @param height the image height
+* @return the synthetic image (ARGB32)
+**/
+QImage DkMiniaturesBenchmark::createImage(int width, int height) {
+
+	QImage img(width, height, QImage::Format_ARGB32);
+
+	for (int y = 0; y < height; y++) {
+
+		QRgb* line = (QRgb*)img.scanLine(y);
+
+		for (int x = 0; x < width; x++) {
+			int t = (x * y) & 63;
+			bool highlight = x % 97 == 48 && y % 89 == 44;
+			line[x] = highlight ? qRgb(255, 255, 255) : qRgb(
+				(x * 255 / qMax(width - 1, 1) + t) & 255,
+				(y * 255 / qMax(height - 1, 1) + t) & 255,
+				(x + y + t) & 255);
+		}
+	}
+
+	return img;
+}
+
+#ifdef WITH_OPENCV
+
+/**
+* Checks all kernels with odd image sizes so that the tails of the row bands and tiles are covered.
+* @return true if all kernels match the reference
+**/
+bool DkMiniaturesBenchmark::verify() {
+
+	bool ok = true;
+
+	QVector<int> depths;
+	depths << CV_8U << CV_16U << CV_32F;
+
+	QVector<int> radii;
+	radii << 2 << 9 << 40;
+
+	for (int dIdx = 0; dIdx < depths.size(); dIdx++) {
+		for (int rIdx = 0; rIdx < radii.size(); rIdx++) {
+
+			if (!verifyBoxBlur(depths[dIdx], radii[rIdx])) {
+				qWarning() << "[Miniatures Benchmark] box blur depth" << depths[dIdx] << "radius" << radii[rIdx] << "FAILED";
+				ok = false;
+			}
+			if (!verifyDiscBlur(depths[dIdx], radii[rIdx])) {
+				qWarning() << "[Miniatures Benchmark] disc blur depth" << depths[dIdx] << "radius" << radii[rIdx] << "FAILED";
+				ok = false;
+			}
+		}
+	}
+
+	QSize size(259, 67);
+	if (!verifyFocusModel(size, QRect(40, 20, 100, 15)) || !verifyFocusModel(size, QRect(0, 0, 259, 30))) {
+		qWarning() << "[Miniatures Benchmark] focus model FAILED";
+		ok = false;
+	}
+
+	return ok;
+}
+
+/**
+* Compares DkMiniaturesFilter::boxBlur to a brute force mean filter.
+**/
+bool DkMiniaturesBenchmark::verifyBoxBlur(int depth, int radius) {
+
+	cv::Mat src = createMat(259, 67, depth);
+	cv::Mat dst;
+	DkMiniaturesFilter::boxBlur(src, dst, radius);
+
+	// rounding of integer images
+	return compare(dst, referenceBoxBlur(src, radius), depth == CV_32F ? 1e-4 : 1.0);
+}
+
+/**
+* Compares DkMiniaturesFilter::discBlur to a spatial convolution.
+* The synthetic images do not have highlights, so the highlight boost is not applied.
+**/
+bool DkMiniaturesBenchmark::verifyDiscBlur(int depth, int radius) {
+
+	cv::Mat src = createMat(259, 67, depth);
+	cv::Mat dst;
+	DkMiniaturesFilter::discBlur(src, dst, radius);
+
+	return compare(dst, referenceDiscBlur(src, radius), depth == CV_32F ? 1e-3 : 1.0);
+}
+
+/**
+* Compares the analytic focus model to a normalized chessboard distance transform
+* (this is how the filter computed the blur amount before).
+**/
+bool DkMiniaturesBenchmark::verifyFocusModel(const QSize& size, const QRect& focusRect) {
+
+	cv::Mat distImg(size.height(), size.width(), CV_8UC1);
+	distImg = 255;
+	cv::Mat roi(distImg, cv::Rect(focusRect.x(), focusRect.y(), focusRect.width(), focusRect.height()));
+	roi.setTo(0);
+
+	cv::distanceTransform(distImg, distImg, CV_DIST_C, 3);
+	cv::normalize(distImg, distImg, 1.0f, 0.0f, cv::NORM_MINMAX);
+
+	DkFocusModel focus = DkFocusModel::fromRect(focusRect, size);
+	cv::Mat depthImg(distImg.size(), CV_32FC1);
+
+	for (int rIdx = 0; rIdx < depthImg.rows; rIdx++)
+		focus.depthRow(rIdx, depthImg.ptr<float>(rIdx));
+
+	return compare(depthImg, distImg, 1e-4);
+}
+
+/**
+* Creates a synthetic image with 4 channels.
+* Values are below the highlight threshold of the bokeh blur.
+* @param width the image width
+* @param height the image height
+* @param depth CV_8U | CV_16U | CV_32F
+* @return the synthetic image
+**/
+cv::Mat DkMiniaturesBenchmark::createMat(int width, int height, int depth) {
+
+	// fixed seed so that a failure can be reproduced
+	cv::Mat img(height, width, CV_32FC4);
+	cv::RNG rng(7);
+	rng.fill(img, cv::RNG::UNIFORM, 0.0, 0.7);
+
+	double scale = (depth == CV_8U) ? 255.0 : (depth == CV_16U) ? 65535.0 : 1.0;
+	img.convertTo(img, CV_MAKETYPE(depth, 4), scale);
+
+	return img;
+}
+
+/**
+* Mean filter that sums every pixel of the (clipped) kernel.
+**/
+cv::Mat DkMiniaturesBenchmark::referenceBoxBlur(const cv::Mat& src, int radius) {
+
+	cv::Mat dst(src.size(), CV_64FC(src.channels()));
+
+	for (int y = 0; y < src.rows; y++) {
+		for (int x = 0; x < src.cols; x++) {
+
+			cv::Rect r(cv::Point(qMax(x - radius, 0), qMax(y - radius, 0)), cv::Point(qMin(x + radius + 1, src.cols), qMin(y + radius + 1, src.rows)));
+			cv::Scalar m = cv::mean(src(r));
+
+			double* dPtr = dst.ptr<double>(y) + x*src.channels();
+			for (int ch = 0; ch < src.channels(); ch++)
+				dPtr[ch] = m[ch];
+		}
+	}
+
+	return dst;
+}
+
+/**
+* Convolves with the same anti-aliased disc in the spatial domain (replicated borders).
+**/
+cv::Mat DkMiniaturesBenchmark::referenceDiscBlur(const cv::Mat& src, int radius) {
+
+	cv::Mat kernel(2*radius+1, 2*radius+1, CV_32FC1);
+
+	for (int y = 0; y < kernel.rows; y++) {
+		for (int x = 0; x < kernel.cols; x++) {
+			float d = std::sqrt((float)((x - radius)*(x - radius) + (y - radius)*(y - radius)));
+			kernel.at<float>(y, x) = qBound(0.0f, radius + 0.5f - d, 1.0f);
+		}
+	}
+	kernel *= 1.0 / cv::sum(kernel)[0];
+
+	cv::Mat srcF;
+	src.convertTo(srcF, CV_64FC(src.channels()));
+
+	cv::Mat dst;
+	cv::filter2D(srcF, dst, CV_64F, kernel, cv::Point(-1, -1), 0, cv::BORDER_REPLICATE);
+
+	return dst;
+}
+
+/**
+* @return true if no value differs by more than tolerance
+**/
+bool DkMiniaturesBenchmark::compare(const cv::Mat& img, const cv::Mat& reference, double tolerance) {
+
+	if (img.size() != reference.size() || img.channels() != reference.channels())
+		return false;
+
+	cv::Mat imgD, refD;
+	img.convertTo(imgD, CV_64F);
+	reference.convertTo(refD, CV_64F);
+
+	double maxDiff = cv::norm(imgD, refD, cv::NORM_INF);
+
+	return maxDiff <= tolerance;
+}
+
+#endif
+
+};
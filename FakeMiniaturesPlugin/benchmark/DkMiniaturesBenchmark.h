@@ -0,0 +1,69 @@
+/*******************************************************************************************************
+ DkMiniaturesBenchmark.h
+ Created on:	19.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QString>
+
+#ifdef WITH_OPENCV
+#include "opencv2/core/core.hpp"
+#endif
+
+namespace nmp {
+
+/**
+* Self check and benchmark of the fake miniatures filter (miniaturesBenchmark executable).
+* The optimized kernels are compared to straightforward reference implementations on small synthetic images.
+* Then the filter is run headlessly for several image sizes, kernel sizes and thread counts and
+* the time, throughput and estimated peak memory are written to the debug output.
+**/
+class DkMiniaturesBenchmark {
+
+public:
+	static bool run(int maxMegaPixels = 16, int iterations = 3);
+
+	static double milliSeconds(const QImage& img, int kernelSize, int blurMode, int numThreads, int iterations);
+	static QImage createImage(int width, int height);
+
+#ifdef WITH_OPENCV
+	static bool verify();
+	static bool verifyBoxBlur(int depth, int radius);
+	static bool verifyDiscBlur(int depth, int radius);
+	static bool verifyFocusModel(const QSize& size, const QRect& focusRect);
+
+	static cv::Mat createMat(int width, int height, int depth);
+
+protected:
+	static cv::Mat referenceBoxBlur(const cv::Mat& src, int radius);
+	static cv::Mat referenceDiscBlur(const cv::Mat& src, int radius);
+	static bool compare(const cv::Mat& img, const cv::Mat& reference, double tolerance);
+#endif
+};
+
+};
@@ -0,0 +1,52 @@
+/*******************************************************************************************************
+ main.cpp
+ Created on:	19.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkMiniaturesBenchmark.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+/**
+* Usage: miniaturesBenchmark [maxMegaPixels] [iterations]
+* @return 0 if all kernels match the reference
+**/
+int main(int argc, char *argv[]) {
+
+	QCoreApplication app(argc, argv);
+	QStringList args = app.arguments();
+
+	int maxMegaPixels = args.size() > 1 ? args[1].toInt() : 16;
+	int iterations = args.size() > 2 ? args[2].toInt() : 3;
+
+	if (maxMegaPixels < 1 || iterations < 1) {
+		qWarning("usage: miniaturesBenchmark [maxMegaPixels] [iterations]");
+		return 2;
+	}
+
+	return nmp::DkMiniaturesBenchmark::run(maxMegaPixels, iterations) ? 0 : 1;
+}
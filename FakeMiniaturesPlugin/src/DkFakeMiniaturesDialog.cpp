@@ -27,10 +27,15 @@
 
 #include "DkFakeMiniaturesDialog.h"
 
+#include <QtConcurrentRun>
+#include <QSettings>
+
 #define INIT_X 0
 #define INIT_Y 0.7117
 #define INIT_WIDTH 1
 #define INIT_HEIGHT 0.1941
+#define PREVIEW_LEVELS 3			// number of pyramid levels of the progressive preview
+#define PREVIEW_MIN_WIDTH 100		// the coarsest level is not smaller than this
 
 namespace nmp {
 
@@ -44,6 +49,13 @@ DkFakeMiniaturesDialog::DkFakeMiniaturesDialog(QWidget* parent, Qt::WindowFlags
 
 DkFakeMiniaturesDialog::~DkFakeMiniaturesDialog() {
 
+	if (previewState)
+		previewState->abort();
+	if (applyState)
+		applyState->abort();
+
+	previewWatcher.waitForFinished();
+	applyWatcher.waitForFinished();
 }
 
 /**
@@ -52,6 +64,7 @@ DkFakeMiniaturesDialog::~DkFakeMiniaturesDialog() {
 void DkFakeMiniaturesDialog::init() {
 
 	isOk = false;
+	img = 0;
 	dialogWidth = 700;
 	dialogHeight = 510;
 	toolsWidth = 200;
@@ -62,6 +75,12 @@ void DkFakeMiniaturesDialog::init() {
 	setWindowTitle(tr("Fake Miniatures"));
 	setFixedSize(dialogWidth, dialogHeight);
 	createLayout();
+
+	connect(&previewWatcher, SIGNAL(finished()), this, SLOT(previewFinished()));
+	connect(&applyWatcher, SIGNAL(finished()), this, SLOT(applyFinished()));
+
+	progressTimer.setInterval(100);
+	connect(&progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
 }
 
 /**
@@ -87,8 +106,18 @@ void DkFakeMiniaturesDialog::createLayout() {
 	kernelSizeWidget = new DkKernelSize(eastWidget, this);
 	saturationWidget = new DkSaturation(eastWidget, this);
 	 
+	QSettings settings;
+	DkMiniaturesParams params;
+	params.loadSettings(settings);
+
+	bokehBox = new QCheckBox(tr("Lens Blur (slow)"), eastWidget);
+	bokehBox->setToolTip(tr("Blurs with a disc kernel and boosts highlights like a real lens"));
+	bokehBox->setChecked(params.blurMode == DkMiniaturesFilter::blur_bokeh);
+	connect(bokehBox, SIGNAL(toggled(bool)), this, SLOT(redrawImgPreview()));
+	 
 	toolsLayout->addWidget(kernelSizeWidget);
 	toolsLayout->addWidget(saturationWidget);
+	toolsLayout->addWidget(bokehBox);
 
 	QSpacerItem* spacer = new QSpacerItem(20,280, QSizePolicy::Minimum, QSizePolicy::Minimum);
 	toolsLayout->addItem(spacer);
@@ -97,7 +126,12 @@ void DkFakeMiniaturesDialog::createLayout() {
 	//QWidget* bottomWidget = new QWidget(eastWidget);
 	QHBoxLayout* bottomWidgetHBoxLayout = new QHBoxLayout();
 
-	QPushButton* buttonOk = new QPushButton(tr("&Ok"));
+	progressBar = new QProgressBar(eastWidget);
+	progressBar->setRange(0, 100);
+	progressBar->hide();
+	toolsLayout->addWidget(progressBar);
+
+	buttonOk = new QPushButton(tr("&Ok"));
 	connect(buttonOk, SIGNAL(clicked()), this, SLOT(okPressed()));
 	QPushButton* buttonCancel = new QPushButton(tr("&Cancel"));
 	connect(buttonCancel, SIGNAL(clicked()), this, SLOT(cancelPressed()));
@@ -150,10 +184,17 @@ void DkFakeMiniaturesDialog::createImgPreview() {
 
 	if(rMin < 1) scaledImg = img->scaled(imgSizeScaled, Qt::KeepAspectRatio, Qt::SmoothTransformation);
 	else scaledImg = *img;
-	
-	imgPreview = applyMiniaturesFilter(scaledImg, QRect(INIT_X, INIT_Y*scaledImg.height(), INIT_WIDTH*scaledImg.width(), INIT_HEIGHT*scaledImg.height())); 
-	
+
+	// the coarse levels are rendered on the GUI thread while the user is dragging
+	previewPyramid.clear();
+	previewPyramid << scaledImg;
+	while (previewPyramid.size() < PREVIEW_LEVELS && previewPyramid.last().width() > 2*PREVIEW_MIN_WIDTH) {
+		const QImage& l = previewPyramid.last();
+		previewPyramid << l.scaled(l.width()/2, qMax(l.height()/2, 1), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	}
+
 	previewLabel->setImgRect(previewImgRect);
+	redrawImgPreview();
 }
 
 /**
@@ -237,168 +278,155 @@ QImage DkFakeMiniaturesDialog::applyMiniaturesFilter(QImage inImg, QRect qRoi) {
 	merge(channelsImg, imgMat);
 	*/
 
-	int kernelSize = kernelSizeWidget->getToolValue();
-	if (inImg == scaledImg) {
-		double diagO = sqrt(img->width()*img->width()+img->height()*img->height());
-		double diagP = sqrt(scaledImg.width()*scaledImg.width()+scaledImg.height()*scaledImg.height());
-		kernelSize = qRound(kernelSize*diagP/diagO);
-	}
-
-	int saturation = saturationWidget->getToolValue();
-	float satFactor = saturation/50.0f + 1; 
-
-	cv::Mat blurImg = DkFakeMiniaturesDialog::qImage2Mat(inImg);
-	cv::Mat distImg(blurImg.size(), CV_8UC1);
-	distImg = 255;
-	cv::Mat roi(distImg, Rect(qRoi.topLeft().x(), qRoi.topLeft().y(), qRoi.width(), qRoi.height()));
-	roi.setTo(0);
-	// blur plane by plane
-	std::vector<cv::Mat> planes;
-	cv::split(blurImg, planes);
-
-	// dist image based on 'some' threshold
-	//cv::Mat distImg;
-	//cv::threshold(planes.at(0), distImg, 40, 255, THRESH_BINARY);
-
-	cv::distanceTransform(distImg, distImg, CV_DIST_C, 3);
-	cv::normalize(distImg, distImg, 1.0f, 0.0f, NORM_MINMAX);
-	
-	for (size_t idx = 0; idx < planes.size(); idx++)
-		planes.at(idx) = blurPanTilt(planes.at(idx), distImg, kernelSize);		// 140 is the maximal blurring kernel size
-		//planes.at(idx) = distImg;
-
-	cv::merge(planes, blurImg);
-	//return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
-
-	if(satFactor > 1) {
-		Mat imgHsv;
-		cvtColor(blurImg, imgHsv, CV_RGB2HSV);
-		std::vector<Mat> imgHsvCh;
-		split(imgHsv, imgHsvCh);
-
-		for (int row = 0; row < imgHsv.rows; row++)
-		{
-			unsigned char *ptr = imgHsvCh[1].ptr<unsigned char>(row);
-	 	
-			for (int col = 0; col < imgHsv.cols; col++) {
-				float tmp = (float)ptr[col] * satFactor;
-				if (tmp > 255.0f) tmp = 255.0f;
-				if (tmp < 0) tmp = 0.0f;
-				ptr[col] = (unsigned char)qRound(tmp);
-			}
-		}
-	
-		merge(imgHsvCh, imgHsv);
-		Mat tempImg(blurImg);
-		cvtColor(imgHsv, blurImg, CV_HSV2RGB);
-	
-		if(tempImg.type() == CV_8UC4) {	// the retImg is always CV_8UC3, so for pics in CV_8UC4 we need to add one channel
-			std::vector<Mat> inImgCh;
-			split(tempImg, inImgCh);
-			std::vector<Mat> retImgCh;
-			split(blurImg, retImgCh);
-			retImgCh.push_back(inImgCh[3]);
-			merge(retImgCh, blurImg);
-		}
-	}
-	
-	return (DkFakeMiniaturesDialog::mat2QImage(blurImg));
+	return DkMiniaturesFilter::apply(inImg, qRoi, scaledKernelSize(inImg), saturationWidget->getToolValue(), 0, blurMode());
 #else
 	return inImg;
 #endif
 }
 
-#ifdef WITH_OPENCV
 /**
- * blur filter
- * @param src input Mat
- * @param depthImg distance transform based on a roi
- * @param maxKernel maximum blur kernel size 
- * @return Mat blurres mat
+ * the kernel size of the slider refers to the original image
+ * @param target the image that is filtered (e.g. the preview)
+ * @return the kernel size that has the same relative size in target
  **/
-Mat DkFakeMiniaturesDialog::blurPanTilt(Mat src, Mat depthImg, int maxKernel) {
+int DkFakeMiniaturesDialog::scaledKernelSize(const QImage& target) const {
 
-	cv::Mat integralImg;
+	int kernelSize = kernelSizeWidget->getToolValue();
 
-	cv::Mat blurImg(src.size(), src.depth());
+	if (!img || img->isNull() || target.size() == img->size())
+		return kernelSize;
 
-	// a template function would have more 'style' here
-	const double* itgrl64Ptr = 0;
+	double diagO = sqrt((double)img->width()*img->width()+(double)img->height()*img->height());
+	double diagP = sqrt((double)target.width()*target.width()+(double)target.height()*target.height());
 
-	// images with an area below 4000*4000 can be compuated using 32 bit 
-	cv::integral(src, integralImg, CV_32S);
-	const unsigned int* itgrl32Ptr = integralImg.ptr<unsigned int>();
+	return qMax(qRound(kernelSize*diagP/diagO), 1);
+}
 
-	for (int rIdx = 0; rIdx < src.rows; rIdx++) {
+/**
+ * @return DkMiniaturesFilter::blur_bokeh if the lens blur is checked
+ **/
+int DkFakeMiniaturesDialog::blurMode() const {
 
-		unsigned char* blurPtr = blurImg.ptr<unsigned char>(rIdx);	// assuming unsigned char
-		const float* depthPtr = depthImg.ptr<float>(rIdx);
-		const unsigned char* srcPtr = src.ptr<unsigned char>(rIdx);
+	return bokehBox->isChecked() ? DkMiniaturesFilter::blur_bokeh : DkMiniaturesFilter::blur_box;
+}
 
-		for (int cIdx = 0; cIdx < src.cols; cIdx++) {
+/**
+ * @return the selected rectangle in scaledImg coordinates
+ **/
+QRect DkFakeMiniaturesDialog::previewRoi() const {
 
-			// kernel size depends on the distance transform, the user selected
-			float dpv = depthPtr[cIdx];
-			float ksf = depthPtr[cIdx]*maxKernel*0.5f;
+	QRect rescaledRect = previewLabel->getROI().normalized();
+	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
 
-			//if (!ks) {
-			//	blurPtr[cIdx] = srcPtr[cIdx];
-			//	continue;
-			//}
-			
-			int ks = qRound(ksf);
-			if (ksf > 0 && ksf < 2) ks = 2;
-			else if (ks == 0) { // early skip
-				blurPtr[cIdx] = srcPtr[cIdx];
-				continue;
-			}
+	return rescaledRect;
+}
 
-			// clip all coordinates
-			int left	= qMax(cIdx-ks, 0);
-			int right	= qMin(cIdx+ks+1, src.cols);	// note not cols-1 since integral img is src.cols+1
-			int bottom	= qMax(rIdx-ks, 0);				// note top bottom is flipped since -y coords
-			int top		= qMin(rIdx+ks+1, src.rows);
-			int area	= (right-left)*(top-bottom);
+/**
+ * on button ok pressed event
+ * the full resolution image is filtered in the background, the dialog is closed when it is done
+ **/
+void DkFakeMiniaturesDialog::okPressed() {
 
-			top *= integralImg.cols;
-			bottom *= integralImg.cols;
+	if (!img || img->isNull() || applyWatcher.isRunning())
+		return;
 
-			float tmp = 0.0f;
+	if (previewState)
+		previewState->abort();
 
-			// compute mean kernel
-			if (area && itgrl32Ptr && ks > 1)
-				tmp = (*(itgrl32Ptr + top+right) + *(itgrl32Ptr + bottom+left) - *(itgrl32Ptr + top+left) - *(itgrl32Ptr + bottom+right))/area;
-			else
-				tmp = srcPtr[cIdx];
+	applyState = QSharedPointer<DkFilterState>(new DkFilterState());
+	QSharedPointer<DkFilterState> state = applyState;
+	QImage fullImg = *img;
+	QRect roi = imageRoi();
+	int kernelSize = kernelSizeWidget->getToolValue();
+	int saturation = saturationWidget->getToolValue();
+	int mode = blurMode();
 
-			if (tmp < 0)
-				tmp = 0.0f;
-			if (tmp > 255)
-				tmp = 255.0f;
+	setProcessing(true);
 
-			blurPtr[cIdx] = qRound(tmp);
-		}
+	applyWatcher.setFuture(QtConcurrent::run([fullImg, roi, kernelSize, saturation, mode, state]() {
+		return DkMiniaturesFilter::apply(fullImg, roi, kernelSize, saturation, state.data(), mode);
+	}));
+}
+
+/**
+ * on button cancel pressed event
+ * aborts the full resolution filter if it is running, closes the dialog otherwise
+ **/
+void DkFakeMiniaturesDialog::cancelPressed() {
+
+	if (applyWatcher.isRunning()) {
+		applyState->abort();
+		return;
 	}
 
-	return blurImg;
+	this->close();
 }
-#endif
 
 /**
- * on button ok pressed event
+ * the full resolution image is ready (or aborted)
  **/
-void DkFakeMiniaturesDialog::okPressed() {
+void DkFakeMiniaturesDialog::applyFinished() {
+
+	setProcessing(false);
+
+	QImage result = applyWatcher.result();
+
+	// null if aborted
+	if (result.isNull())
+		return;
 
+	resultImg = result;
 	isOk = true;
+	saveSettings();
 	this->close();
 }
 
+void DkFakeMiniaturesDialog::updateProgress() {
+
+	if (applyState)
+		progressBar->setValue(applyState->progress());
+}
+
 /**
- * on button cancel pressed event
+ * stores the current values - they are used by the batch action of the plugin
  **/
-void DkFakeMiniaturesDialog::cancelPressed() {
+void DkFakeMiniaturesDialog::saveSettings() const {
 
-	this->close();
+	if (!img || img->isNull())
+		return;
+
+	QSettings settings;
+
+	DkMiniaturesParams params;
+	params.loadSettings(settings);
+
+	QRect roi = imageRoi();
+	params.focusTop = roi.top() / (double)img->height();
+	params.focusBottom = (roi.bottom() + 1) / (double)img->height();
+	params.maxKernel = kernelSizeWidget->getToolValue();
+	params.saturation = saturationWidget->getToolValue();
+	params.blurMode = blurMode();
+	params.saveSettings(settings);
+}
+
+/**
+ * disables the controls while the full resolution image is filtered
+ **/
+void DkFakeMiniaturesDialog::setProcessing(bool processing) {
+
+	kernelSizeWidget->setEnabled(!processing);
+	saturationWidget->setEnabled(!processing);
+	bokehBox->setEnabled(!processing);
+	previewLabel->setEnabled(!processing);
+	buttonOk->setEnabled(!processing);
+
+	progressBar->setValue(0);
+	progressBar->setVisible(processing);
+
+	if (processing)
+		progressTimer.start();
+	else
+		progressTimer.stop();
 }
 
 /**
@@ -407,6 +435,7 @@ void DkFakeMiniaturesDialog::cancelPressed() {
 void DkFakeMiniaturesDialog::showEvent(QShowEvent *event) {
 
 	isOk = false;	
+	resultImg = QImage();
 	double diag = sqrt(img->width()*img->width()+img->height()*img->height());
 	kernelSizeWidget->setToolValue(qMin(qMax(int(diag * 0.02), 5), 140));
 	saturationWidget->setToolValue(2);
@@ -421,37 +450,84 @@ void DkFakeMiniaturesDialog::setImage(const QImage *img) {
 
 /**
  * the dialog returns image after execution
+ * @return the filtered full resolution image (null if the dialog was canceled)
  **/
 QImage DkFakeMiniaturesDialog::getImage() {
 
-	QRect rescaledRect = previewLabel->getROI();
-	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
+	return resultImg;
+};
+
+/**
+ * @return the selected rectangle in image coordinates
+ **/
+QRect DkFakeMiniaturesDialog::imageRoi() const {
+
+	QRect rescaledRect = previewRoi();
 	if(rMin < 1) {
 		rescaledRect.moveTo(rescaledRect.topLeft().x()/rMin, rescaledRect.topLeft().y()/rMin);
 		rescaledRect.setWidth(rescaledRect.width()/rMin);
 		rescaledRect.setHeight(rescaledRect.height()/rMin);
 	}
-	QRect imgRect = (*(this->img)).rect();
-	if(rescaledRect.topLeft().x() < imgRect.topLeft().x()) rescaledRect.topLeft().setX(imgRect.topLeft().x());
-	if(rescaledRect.topLeft().y() < imgRect.topLeft().y()) rescaledRect.topLeft().setY(imgRect.topLeft().y());
-	if(rescaledRect.bottomRight().x() > imgRect.bottomRight().x()) rescaledRect.bottomRight().setX(imgRect.bottomRight().x());
-	if(rescaledRect.bottomRight().y() > imgRect.bottomRight().y()) rescaledRect.bottomRight().setY(imgRect.bottomRight().y());
-
-	QImage miniature = applyMiniaturesFilter(*(this->img), rescaledRect);
-	return miniature;
+
+	return rescaledRect & img->rect();
 };
 
 /**
  * slot that redraws preview after slider change
+ * the coarsest pyramid level is filtered immediately, the preview resolution is rendered in the background
+ * a running background job is aborted
  **/
 void DkFakeMiniaturesDialog::redrawImgPreview() {
-	
-	QRect rescaledRect = previewLabel->getROI();
-	rescaledRect.moveTo(rescaledRect.topLeft().x()-previewImgRect.topLeft().x(), rescaledRect.topLeft().y()-previewImgRect.topLeft().y());
-	setImagePreview(applyMiniaturesFilter(getScaledImg(), rescaledRect));
-	drawImgPreview();
+
+	if (previewPyramid.isEmpty())
+		return;
+
+	if (previewState)
+		previewState->abort();
+
+	QRect roi = previewRoi();
+	int saturation = saturationWidget->getToolValue();
+
+	// coarse preview - always box blurred to keep it interactive
+	const QImage& coarseImg = previewPyramid.last();
+	if (previewPyramid.size() > 1) {
+		double s = coarseImg.width() / (double)scaledImg.width();
+		QRect coarseRoi(qRound(roi.x()*s), qRound(roi.y()*s), qRound(roi.width()*s), qRound(roi.height()*s));
+
+		// the last coarse frame is released so that its buffer is reused without detaching
+		imgPreview = QImage();
+		DkMiniaturesFilter::apply(coarseImg, coarseBuffer, DkFocusModel::fromRect(coarseRoi, coarseImg.size()), scaledKernelSize(coarseImg), saturation);
+		setImagePreview(coarseBuffer);
+		drawImgPreview();
+	}
+
+	// refine
+	previewState = QSharedPointer<DkFilterState>(new DkFilterState());
+	QSharedPointer<DkFilterState> state = previewState;
+	QImage fineImg = scaledImg;
+	int kernelSize = scaledKernelSize(fineImg);
+	int mode = blurMode();
+
+	previewWatcher.setFuture(QtConcurrent::run([fineImg, roi, kernelSize, saturation, mode, state]() {
+		return DkMiniaturesFilter::apply(fineImg, roi, kernelSize, saturation, state.data(), mode);
+	}));
 };
 
+/**
+ * the preview resolution is ready
+ **/
+void DkFakeMiniaturesDialog::previewFinished() {
+
+	QImage preview = previewWatcher.result();
+
+	// null if aborted
+	if (preview.isNull())
+		return;
+
+	setImagePreview(preview);
+	drawImgPreview();
+}
+
 /**************************************************************
 * DkPreviewLabel: label for displaying image preview
 ***************************************************************/
@@ -483,6 +559,7 @@ void DkPreviewLabel::mouseMoveEvent(QMouseEvent *e) {
 		QPoint pos = e->pos();
 		if(pos.x() > previewImgRect.topLeft().x() && pos.x() < previewImgRect.bottomRight().x() && pos.y() > previewImgRect.topLeft().y() && pos.y() < previewImgRect.bottomRight().y()) {
 			selectionRect.setBottomRight(pos);
+			fmDialog->redrawImgPreview();	// coarse preview while dragging
 		}
 		repaint();
     }
@@ -33,11 +33,17 @@
 #include <QPushButton>
 #include <QSpinBox>
 #include <QSlider>
+#include <QCheckBox>
 #include <QDialog>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QProgressBar>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QSharedPointer>
 
 #include "BorderLayout.h"
+#include "DkMiniaturesFilter.h"
 
 // OpenCV
 #ifdef WITH_OPENCV
@@ -78,6 +84,9 @@ class DkFakeMiniaturesDialog : public QDialog {
 
 	public slots:
 		void redrawImgPreview();
+		void previewFinished();
+		void applyFinished();
+		void updateProgress();
 
 	protected slots:
 		void okPressed();
@@ -95,6 +104,21 @@ class DkFakeMiniaturesDialog : public QDialog {
 		float rMin;
 		DkKernelSize *kernelSizeWidget;
 		DkSaturation *saturationWidget;
+		QCheckBox* bokehBox;
+
+		// progressive preview: a coarse level is rendered immediately, the preview resolution in the background
+		QVector<QImage> previewPyramid;
+		QImage coarseBuffer;		// the coarse preview is rendered into this buffer
+		QFutureWatcher<QImage> previewWatcher;
+		QSharedPointer<DkFilterState> previewState;
+
+		// the full resolution image is rendered in the background when ok is pressed
+		QFutureWatcher<QImage> applyWatcher;
+		QSharedPointer<DkFilterState> applyState;
+		QImage resultImg;
+		QTimer progressTimer;
+		QProgressBar* progressBar;
+		QPushButton* buttonOk;
 
 		int previewWidth;
 		int previewHeight;
@@ -105,77 +129,13 @@ class DkFakeMiniaturesDialog : public QDialog {
 		void createLayout();
 		void showEvent(QShowEvent *event);
 		void createImgPreview();		
+		QRect previewRoi() const;
+		QRect imageRoi() const;
+		void setProcessing(bool processing);
+		void saveSettings() const;
+		int scaledKernelSize(const QImage& target) const;
+		int blurMode() const;
 
-#ifdef WITH_OPENCV
-		Mat blurPanTilt(Mat src, Mat depthImg, int maxKernel);
-
-	/**
-	 * Converts a QImage to a Mat
-	 * @param img formats supported: ARGB32 | RGB32 | RGB888 | Indexed8
-	 * @return cv::Mat the corresponding Mat
-	 **/ 
-	static Mat qImage2Mat(const QImage img) {
-
-		Mat mat2;
-		QImage cImg;	// must be initialized here!	(otherwise the data is lost before clone())
-
-		if (img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_RGB32 ) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC4, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "ARGB32 or RGB32";
-		}
-		else if (img.format() == QImage::Format_RGB888) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC3, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "RGB888";
-		}
-		else if (img.format() == QImage::Format_Indexed8) {
-			mat2 = Mat(img.height(), img.width(), CV_8UC1, (uchar*)img.bits(), img.bytesPerLine());
-			//qDebug() << "indexed...";
-		}
-		else {
-			//qDebug() << "image flag: " << img.format();
-			cImg = img.convertToFormat(QImage::Format_ARGB32);
-			mat2 = Mat(cImg.height(), cImg.width(), CV_8UC4, (uchar*)cImg.bits(), cImg.bytesPerLine());
-			//qDebug() << "I need to convert the QImage to ARGB32";
-		}
-
-		mat2 = mat2.clone();	// we need to own the pointer
-
-		return mat2; 
-	}
-
-	/**
-	 * Converts a cv::Mat to a QImage.
-	 * @param img supported formats CV8UC1 | CV_8UC3 | CV_8UC4
-	 * @return QImage the corresponding QImage
-	 **/ 
-	static QImage mat2QImage(Mat img) {
-
-		QImage qImg;
-
-		// since Mat header is copied, a new buffer should be allocated (check this!)
-		if (img.depth() == CV_32F)
-			img.convertTo(img, CV_8U, 255);
-
-		if (img.type() == CV_8UC1) {
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_Indexed8);	// opencv uses size_t if for scaling in x64 applications
-			//Mat tmp;
-			//cvtColor(img, tmp, CV_GRAY2RGB);	// Qt does not support writing to index8 images
-			//img = tmp;
-		}
-		if (img.type() == CV_8UC3) {
-			
-			//cv::cvtColor(img, img, CV_RGB2BGR);
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_RGB888);
-		}
-		if (img.type() == CV_8UC4) {
-			qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_ARGB32);
-		}
-
-		qImg = qImg.copy();
-
-		return qImg;
-	}
-#endif
 
 };
 
@@ -27,8 +27,47 @@
 
 #include "DkFakeMiniaturesPlugin.h"
 
+#include <QThread>
+#include <QApplication>
+#include <QSettings>
+
 namespace nmp {
 
+/**
+*	Constructor
+**/
+DkFakeMiniaturesPlugin::DkFakeMiniaturesPlugin(QObject* parent) : QObject(parent) {
+
+	// create run IDs
+	QVector<QString> runIds;
+	runIds.resize(id_end);
+
+	runIds[id_dialog] = "e1a9b0c14c2a4c5c9d3c8f0a6b7d2e41";
+	runIds[id_batch] = "5f3d7c2b8e9a41d0b6c4a2e8f1d07b93";
+	mRunIDs = runIds.toList();
+
+	// create menu actions
+	QVector<QString> menuNames;
+	menuNames.resize(id_end);
+
+	menuNames[id_dialog] = tr("Fake Miniature...");
+	menuNames[id_batch] = tr("Fake Miniature (Last Settings)");
+	mMenuNames = menuNames.toList();
+
+	// create menu status tips
+	QVector<QString> statusTips;
+	statusTips.resize(id_end);
+
+	statusTips[id_dialog] = tr("Select the focus band and the amount of blur in a dialog.");
+	statusTips[id_batch] = tr("Applies the fake miniature filter with the settings of the last dialog run - use this action for batch processing.");
+	mMenuStatusTips = statusTips.toList();
+
+	QSettings settings;
+	DkMiniaturesParams params;
+	params.loadSettings(settings);
+	mMemoryBudget.release(qMax(params.maxMemory, 1));
+}
+
 /**
 * Returns unique ID for the generated dll
 **/
@@ -45,6 +84,27 @@ QImage DkFakeMiniaturesPlugin::image() const {
    return QImage(":/nomacsPluginFakeMin/img/fakeMinDesc.png");
 };
 
+QList<QAction*> DkFakeMiniaturesPlugin::createActions(QWidget* parent) {
+
+	if (mActions.empty()) {
+
+		for (int idx = 0; idx < id_end; idx++) {
+			QAction* ca = new QAction(mMenuNames[idx], parent);
+			ca->setObjectName(mMenuNames[idx]);
+			ca->setStatusTip(mMenuStatusTips[idx]);
+			ca->setData(mRunIDs[idx]);	// runID needed for calling function runPlugin()
+			mActions.append(ca);
+		}
+	}
+
+	return mActions;
+}
+
+QList<QAction*> DkFakeMiniaturesPlugin::pluginActions() const {
+
+	return mActions;
+}
+
 /**
 * Main function: runs plug-in based on its ID
 * @param plug-in ID
@@ -52,29 +112,14 @@ QImage DkFakeMiniaturesPlugin::image() const {
 **/
 QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runPlugin(const QString &runID, QSharedPointer<nmc::DkImageContainer> imgC) const {
 
-	qDebug() << "run id" << runID << "plugin id" << PLUGIN_ID;
-	if (runID == PLUGIN_ID && imgC) {
-		QMainWindow* mainWindow = getMainWindow();
-		DkFakeMiniaturesDialog* fakeMiniaturesDialog;
-		if(mainWindow) 
-			fakeMiniaturesDialog = new DkFakeMiniaturesDialog(mainWindow);
-		else 
-			fakeMiniaturesDialog = new DkFakeMiniaturesDialog();
+	if (!imgC)
+		return imgC;
 
-    QImage img = imgC->image();
-		fakeMiniaturesDialog->setImage(&img);
-
-		bool done = fakeMiniaturesDialog->exec();
-
-		QImage returnImg(imgC->image());
-		if (fakeMiniaturesDialog->wasOkPressed()) 
-			returnImg = fakeMiniaturesDialog->getImage();
-
-		fakeMiniaturesDialog->deleteLater();
-
-		imgC->setImage(returnImg, tr("Fake Miniature"));
-	}
-	else if (imgC) {
+	if (runID == mRunIDs[id_batch])
+		return runBatch(imgC);
+	else if (runID == mRunIDs[id_dialog] || runID == PLUGIN_ID)
+		return runDialog(imgC);
+	else {
 		QMessageBox msgBox;
 		msgBox.setText("Wrong GUID!");
 		msgBox.setIcon(QMessageBox::Warning);
@@ -84,5 +129,66 @@ QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runPlugin(const QS
 	return imgC;
 };
 
+/**
+* Shows the dialog - the settings are saved if the user presses ok.
+**/
+QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runDialog(QSharedPointer<nmc::DkImageContainer> imgC) const {
+
+	// the batch runs plugins in worker threads
+	if (QThread::currentThread() != QApplication::instance()->thread()) {
+		qWarning() << "[Fake Miniatures] the dialog cannot be used in batch processing - please choose" << mMenuNames[id_batch];
+		return imgC;
+	}
+
+	QMainWindow* mainWindow = getMainWindow();
+	DkFakeMiniaturesDialog* fakeMiniaturesDialog;
+	if(mainWindow) 
+		fakeMiniaturesDialog = new DkFakeMiniaturesDialog(mainWindow);
+	else 
+		fakeMiniaturesDialog = new DkFakeMiniaturesDialog();
+
+	QImage img = imgC->image();
+	fakeMiniaturesDialog->setImage(&img);
+
+	bool done = fakeMiniaturesDialog->exec();
+
+	QImage returnImg(imgC->image());
+	if (fakeMiniaturesDialog->wasOkPressed()) 
+		returnImg = fakeMiniaturesDialog->getImage();
+
+	fakeMiniaturesDialog->deleteLater();
+
+	imgC->setImage(returnImg, tr("Fake Miniature"));
+
+	return imgC;
+};
+
+/**
+* Applies the filter with the saved settings.
+* This function is thread-safe. Parallel calls (e.g. from the batch processing)
+* wait until their estimated memory fits into the budget.
+**/
+QSharedPointer<nmc::DkImageContainer> DkFakeMiniaturesPlugin::runBatch(QSharedPointer<nmc::DkImageContainer> imgC) const {
+
+	QSettings settings;	// each thread needs its own QSettings object
+	DkMiniaturesParams params;
+	params.loadSettings(settings);
+
+	QImage img = imgC->image();
+	if (img.isNull())
+		return imgC;
+
+	// a single image that exceeds the budget gets the whole budget
+	int mem = qMin(DkMiniaturesFilter::memoryUsage(img.size(), img.depth()), qMax(params.maxMemory, 1));
+
+	mMemoryBudget.acquire(mem);
+	QImage result = DkMiniaturesFilter::apply(img, params);
+	mMemoryBudget.release(mem);
+
+	imgC->setImage(result, tr("Fake Miniature"));
+
+	return imgC;
+};
+
 };
 
@@ -34,9 +34,12 @@
 #include <QStringList>
 #include <QString>
 #include <QMessageBox>
+#include <QAction>
+#include <QSemaphore>
 
 #include "DkPluginInterface.h"
 #include "DkFakeMiniaturesDialog.h"
+#include "DkMiniaturesFilter.h"
 
 namespace nmp {
 
@@ -46,10 +49,33 @@ class DkFakeMiniaturesPlugin : public QObject, nmc::DkPluginInterface {
 	Q_PLUGIN_METADATA(IID "com.nomacs.ImageLounge.DkFakeMiniaturesPlugin/3.2" FILE "DkFakeMiniaturesPlugin.json")
 
 public:
+	DkFakeMiniaturesPlugin(QObject* parent = 0);
+
     QString id() const override;
     QImage image() const override;
 
+	QList<QAction*> createActions(QWidget* parent) override;
+	QList<QAction*> pluginActions() const override;
 	QSharedPointer<nmc::DkImageContainer> runPlugin(const QString &runID = QString(), QSharedPointer<nmc::DkImageContainer> image = QSharedPointer<nmc::DkImageContainer>()) const override;
+
+	enum {
+		id_dialog,
+		id_batch,
+		// add actions here
+
+		id_end
+	};
+
+protected:
+	QSharedPointer<nmc::DkImageContainer> runDialog(QSharedPointer<nmc::DkImageContainer> imgC) const;
+	QSharedPointer<nmc::DkImageContainer> runBatch(QSharedPointer<nmc::DkImageContainer> imgC) const;
+
+	QList<QAction*> mActions;
+	QStringList mRunIDs;
+	QStringList mMenuNames;
+	QStringList mMenuStatusTips;
+
+	mutable QSemaphore mMemoryBudget;	// MB that can be used by parallel batch jobs
 };
 
 };
@@ -0,0 +1,1044 @@
+/*******************************************************************************************************
+ DkMiniaturesFilter.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkMiniaturesFilter.h"
+
+#include <QThread>
+#include <QSettings>
+#include <QPair>
+#include <QtConcurrentMap>
+#include <QtCore/qmath.h>
+
+#include <vector>
+#include <cmath>
+
+#ifdef WITH_OPENCV
+#include "opencv2/imgproc/imgproc.hpp"
+#endif
+
+#define DK_MIN_BAND_HEIGHT 32		// rows per band - smaller bands do not pay off
+#define DK_MAX_BLUR_LEVELS 10
+#define DK_LEVEL_STEP 6.0			// radius difference of two blur levels
+#define DK_BOKEH_TILE 256			// minimal output tile size of the FFT blur
+#define DK_BOKEH_THRESHOLD 0.75f	// highlights above this (normalized) value are boosted
+#define DK_BOKEH_BOOST 4.0f			// gain of the brightest pixels
+
+namespace nmp {
+
+#ifdef WITH_OPENCV
+
+/**
+* Per depth types of the blur kernels.
+* sum_type must hold the row prefix sums of the box blur without overflow.
+**/
+template <typename T> struct DkBlurTraits;
+
+template <> struct DkBlurTraits<unsigned char> {
+	typedef unsigned int sum_type;		// < 2^32 for rows with up to 58000 pixels and a radius of 140
+	static float maxValue() { return 255.0f; };
+	static unsigned char fromFloat(float val) { return (unsigned char)(val + 0.5f); };
+};
+
+template <> struct DkBlurTraits<unsigned short> {
+	typedef quint64 sum_type;
+	static float maxValue() { return 65535.0f; };
+	static unsigned short fromFloat(float val) { return (unsigned short)(val + 0.5f); };
+};
+
+template <> struct DkBlurTraits<float> {
+	typedef double sum_type;
+	static float maxValue() { return 1.0f; };
+	static float fromFloat(float val) { return val; };
+};
+
+#endif
+
+DkFocusModel::DkFocusModel() {
+
+	type = focus_rect;
+	cosA = 1.0;
+	sinA = 0.0;
+	falloff = 1.0;
+	invMaxDist = 0.0;
+}
+
+/**
+* Creates an axis aligned focus rectangle.
+* The distance is the chessboard distance to the rectangle (like cv::distanceTransform with CV_DIST_C).
+* @param rect the focus rectangle
+* @param size the image size
+* @param falloff the normalized distance is raised to this power
+**/
+DkFocusModel DkFocusModel::fromRect(const QRect& rect, const QSize& size, double falloff) {
+
+	DkFocusModel m;
+	m.type = focus_rect;
+	m.imgSize = size;
+	m.rect = rect & QRect(QPoint(), size);
+
+	// no focus area - nothing is blurred
+	if (m.rect.isEmpty())
+		return m;
+
+	m.colDist.resize(size.width());
+	for (int cIdx = 0; cIdx < size.width(); cIdx++)
+		m.colDist[cIdx] = (float)qMax(qMax(m.rect.left() - cIdx, cIdx - m.rect.right()), 0);
+
+	m.init(0.0, falloff);
+
+	return m;
+}
+
+/**
+* Creates a (rotated) focus band.
+* @param center a point on the band's center line
+* @param height the band height
+* @param angle the rotation of the band in degrees
+* @param size the image size
+* @param falloff the normalized distance is raised to this power
+**/
+DkFocusModel DkFocusModel::fromBand(const QPointF& center, double height, double angle, const QSize& size, double falloff) {
+
+	DkFocusModel m;
+	m.type = focus_band;
+	m.imgSize = size;
+	m.center = center;
+	m.radii = QSizeF(0, qAbs(height) * 0.5);
+	m.init(angle, falloff);
+
+	return m;
+}
+
+/**
+* Creates a (rotated) elliptic focus area.
+* @param center the ellipse center
+* @param radii the radii of the ellipse
+* @param angle the rotation of the ellipse in degrees
+* @param size the image size
+* @param falloff the normalized distance is raised to this power
+**/
+DkFocusModel DkFocusModel::fromEllipse(const QPointF& center, const QSizeF& radii, double angle, const QSize& size, double falloff) {
+
+	DkFocusModel m;
+	m.type = focus_ellipse;
+	m.imgSize = size;
+	m.center = center;
+	m.radii = QSizeF(qMax(radii.width(), 1.0), qMax(radii.height(), 1.0));
+	m.init(angle, falloff);
+
+	return m;
+}
+
+void DkFocusModel::init(double angle, double falloff) {
+
+	this->falloff = (falloff > 0) ? falloff : 1.0;
+	cosA = qCos(angle * M_PI / 180.0);
+	sinA = qSin(angle * M_PI / 180.0);
+
+	// all distances are convex - so the maximum is at one of the corners
+	double maxDist = 0;
+	maxDist = qMax(maxDist, distance(0, 0));
+	maxDist = qMax(maxDist, distance(imgSize.width()-1, 0));
+	maxDist = qMax(maxDist, distance(0, imgSize.height()-1));
+	maxDist = qMax(maxDist, distance(imgSize.width()-1, imgSize.height()-1));
+
+	invMaxDist = (maxDist > 0) ? 1.0 / maxDist : 0.0;
+}
+
+/**
+* @return the (not normalized) distance of a pixel to the focus area
+**/
+double DkFocusModel::distance(double x, double y) const {
+
+	double dx = x - center.x();
+	double dy = y - center.y();
+	double u = dx * cosA + dy * sinA;		// along the band
+	double v = -dx * sinA + dy * cosA;		// across the band
+
+	switch (type) {
+	case focus_rect:
+		return qMax(qMax(rect.left() - x, x - rect.right()), qMax(qMax(rect.top() - y, y - rect.bottom()), 0.0));
+	case focus_band:
+		return qMax(qAbs(v) - radii.height(), 0.0);
+	case focus_ellipse: {
+		double r = qSqrt(u*u / (radii.width()*radii.width()) + v*v / (radii.height()*radii.height()));
+		return qMax(r - 1.0, 0.0) * qMin(radii.width(), radii.height());
+	}
+	}
+
+	return 0.0;
+}
+
+/**
+* Computes the normalized blur amount of an image row.
+* This function is thread-safe.
+* @param row the row index
+* @param dst a buffer with size().width() elements - 0 = in focus, 1 = maximal blur
+**/
+void DkFocusModel::depthRow(int row, float* dst) const {
+
+	int cols = imgSize.width();
+	float scale = (float)invMaxDist;
+
+	if (scale <= 0.0f) {
+		for (int cIdx = 0; cIdx < cols; cIdx++)
+			dst[cIdx] = 0.0f;
+		return;
+	}
+
+	if (type == focus_rect) {
+		float dy = (float)qMax(qMax(rect.top() - row, row - rect.bottom()), 0);
+		const float* cd = colDist.constData();
+		for (int cIdx = 0; cIdx < cols; cIdx++)
+			dst[cIdx] = qMax(cd[cIdx], dy) * scale;
+	}
+	else {
+		// u and v are linear in x
+		double dy = row - center.y();
+		float u0 = (float)(-center.x() * cosA + dy * sinA);
+		float v0 = (float)(center.x() * sinA + dy * cosA);
+		float du = (float)cosA;
+		float dv = (float)-sinA;
+
+		if (type == focus_band) {
+			float h = (float)radii.height();
+			for (int cIdx = 0; cIdx < cols; cIdx++)
+				dst[cIdx] = qMax(qAbs(v0 + cIdx * dv) - h, 0.0f) * scale;
+		}
+		else {
+			float irx = 1.0f / (float)radii.width();
+			float iry = 1.0f / (float)radii.height();
+			float minR = (float)qMin(radii.width(), radii.height());
+			for (int cIdx = 0; cIdx < cols; cIdx++) {
+				float u = (u0 + cIdx * du) * irx;
+				float v = (v0 + cIdx * dv) * iry;
+				dst[cIdx] = qMax(std::sqrt(u*u + v*v) - 1.0f, 0.0f) * minR * scale;
+			}
+		}
+	}
+
+	if (falloff != 1.0) {
+		float f = (float)falloff;
+		for (int cIdx = 0; cIdx < cols; cIdx++)
+			dst[cIdx] = std::pow(dst[cIdx], f);
+	}
+}
+
+DkMiniaturesParams::DkMiniaturesParams() {
+
+	// same as the initial selection of the dialog
+	focusTop = 0.7117;
+	focusBottom = 0.7117 + 0.1941;
+	focusAngle = 0.0;
+	focusShape = DkFocusModel::focus_band;
+	maxKernel = 0;
+	saturation = 50;
+	falloff = 1.0;
+	blurMode = DkMiniaturesFilter::blur_box;
+	maxMemory = 2048;
+}
+
+/**
+* @return the focus band (which spans the whole image) or an ellipse that is inscribed into the band
+**/
+DkFocusModel DkMiniaturesParams::focusModel(const QSize& size) const {
+
+	double top = qBound(0.0, focusTop, 1.0) * size.height();
+	double bottom = qBound(0.0, focusBottom, 1.0) * size.height();
+	QPointF center(size.width() * 0.5, (top + bottom) * 0.5);
+
+	if (focusShape == DkFocusModel::focus_ellipse)
+		return DkFocusModel::fromEllipse(center, QSizeF(size.width() * 0.5, qAbs(bottom - top) * 0.5), focusAngle, size, falloff);
+
+	return DkFocusModel::fromBand(center, bottom - top, focusAngle, size, falloff);
+}
+
+/**
+* @return the maximal kernel size - if it is automatic, 2% of the image diagonal (the default of the dialog)
+**/
+int DkMiniaturesParams::kernelSize(const QSize& size) const {
+
+	if (maxKernel > 0)
+		return maxKernel;
+
+	double diag = qSqrt((double)size.width()*size.width() + (double)size.height()*size.height());
+	return qMin(qMax(qRound(diag * 0.02), 5), 140);
+}
+
+void DkMiniaturesParams::loadSettings(QSettings& settings) {
+
+	settings.beginGroup("FakeMiniaturesPlugin");
+	focusTop = settings.value("focusTop", focusTop).toDouble();
+	focusBottom = settings.value("focusBottom", focusBottom).toDouble();
+	focusAngle = settings.value("focusAngle", focusAngle).toDouble();
+	focusShape = settings.value("focusShape", focusShape).toInt();
+	maxKernel = settings.value("kernelSize", maxKernel).toInt();
+	saturation = settings.value("saturation", saturation).toInt();
+	falloff = settings.value("falloff", falloff).toDouble();
+	blurMode = settings.value("blurMode", blurMode).toInt();
+	maxMemory = settings.value("maxMemory", maxMemory).toInt();
+	settings.endGroup();
+}
+
+void DkMiniaturesParams::saveSettings(QSettings& settings) const {
+
+	settings.beginGroup("FakeMiniaturesPlugin");
+	settings.setValue("focusTop", focusTop);
+	settings.setValue("focusBottom", focusBottom);
+	settings.setValue("focusAngle", focusAngle);
+	settings.setValue("focusShape", focusShape);
+	settings.setValue("kernelSize", maxKernel);
+	settings.setValue("saturation", saturation);
+	settings.setValue("falloff", falloff);
+	settings.setValue("blurMode", blurMode);
+	settings.setValue("maxMemory", maxMemory);
+	settings.endGroup();
+}
+
+/**
+* Applies the fake miniatures filter with a focus band.
+* @param img the input image
+* @param params the filter parameters
+* @param state if not 0, the progress is reported and a null image is returned as soon as possible if it is aborted
+* @return the filtered image
+**/
+QImage DkMiniaturesFilter::apply(const QImage& img, const DkMiniaturesParams& params, DkFilterState* state) {
+
+	return apply(img, params.focusModel(img.size()), params.kernelSize(img.size()), params.saturation, state, params.blurMode);
+}
+
+/**
+* Applies the fake miniatures filter with an axis aligned focus rectangle.
+* @param img the input image
+* @param focusRect the rectangle that is not blurred
+* @param kernelSize the maximal blur kernel size (relative to img)
+* @param saturation the saturation boost [0 100] (0 = no change)
+* @param state if not 0, the progress is reported and a null image is returned as soon as possible if it is aborted
+* @param blurMode blur_box or blur_bokeh
+* @return the filtered image
+**/
+QImage DkMiniaturesFilter::apply(const QImage& img, const QRect& focusRect, int kernelSize, int saturation, DkFilterState* state, int blurMode) {
+
+	return apply(img, DkFocusModel::fromRect(focusRect, img.size()), kernelSize, saturation, state, blurMode);
+}
+
+/**
+* Estimates the peak memory of the filter.
+* @param size the image size
+* @param depth the bits per pixel of the image (QImage::depth())
+* @return the memory in MB
+**/
+int DkMiniaturesFilter::memoryUsage(const QSize& size, int depth) {
+
+	// input, converted input, two blur levels, output (wrapped - no conversion)
+	// the FFT buffers of the bokeh mode are bounded by the tile size
+	qint64 bytes = (qint64)size.width() * size.height() * 5 * qMax(depth / 8, 4);
+
+	return (int)qMax(bytes >> 20, (qint64)1);
+}
+
+/**
+* Applies the fake miniatures filter.
+* This function does not depend on the GUI and is thread-safe.
+* @param img the input image
+* @param focus the focus model which has the size of img
+* @param kernelSize the maximal blur kernel size (relative to img)
+* @param saturation the saturation boost [0 100] (0 = no change)
+* @param state if not 0, the progress is reported and a null image is returned as soon as possible if it is aborted
+* @param blurMode blur_box or blur_bokeh
+* @return the filtered image
+**/
+QImage DkMiniaturesFilter::apply(const QImage& img, const DkFocusModel& focus, int kernelSize, int saturation, DkFilterState* state, int blurMode) {
+
+#ifdef WITH_OPENCV
+	QImage dst;
+
+	if (!apply(img, dst, focus, kernelSize, saturation, state, blurMode))
+		return QImage();
+
+	return dst;
+#else
+	return img;
+#endif
+}
+
+/**
+* Applies the fake miniatures filter and writes the result to a preallocated image.
+* The scanlines of img and dst are wrapped without copying. Hence, no full-size copy is made
+* if img has a supported format and dst has the same size and format as img (e.g. the last result).
+* Otherwise, img is converted once and dst is reallocated.
+* @param img the input image
+* @param dst the output image - it is detached if its data is shared
+* @param focus the focus model which has the size of img
+* @param kernelSize the maximal blur kernel size (relative to img)
+* @param saturation the saturation boost [0 100] (0 = no change)
+* @param state if not 0, the progress is reported and false is returned as soon as possible if it is aborted
+* @param blurMode blur_box or blur_bokeh
+* @return false if the filter was aborted
+**/
+bool DkMiniaturesFilter::apply(const QImage& img, QImage& dst, const DkFocusModel& focus, int kernelSize, int saturation, DkFilterState* state, int blurMode) {
+
+	if (img.isNull()) {
+		dst = img;
+		return true;
+	}
+
+#ifdef WITH_OPENCV
+	float satFactor = saturation/50.0f + 1;
+
+	const QImage cImg = toSupportedFormat(img);	// const: wrapping must not detach it
+
+	if (dst.size() != cImg.size() || dst.format() != cImg.format())
+		dst = QImage(cImg.size(), cImg.format());
+	dst.setColorTable(cImg.colorTable());
+
+	cv::Mat dstMat = wrapImage(dst);
+
+	// all channels are blurred at once and the saturation is boosted in the same pass
+	return blurPanTilt(wrapImage(cImg), dstMat, focus, kernelSize, satFactor, state, blurMode);		// 140 is the maximal blurring kernel size
+#else
+	dst = img;
+	return true;
+#endif
+}
+
+#ifdef WITH_OPENCV
+
+/**
+* Blurs an image with a kernel size that depends on the distance map.
+* All channels are processed in one pass (no split / merge) and the saturation is boosted while the output is written.
+* This replaces the integral image based implementation which overflowed for images above 4000x4000 pixels.
+* @param src the input image (CV_8U | CV_16U | CV_32F with 1, 3 or 4 channels)
+* @param focus the focus model which provides the blur amount (0 = in focus, 1 = maximal blur)
+* @param maxKernel the maximal blur kernel size
+* @param satFactor the saturation is multiplied by this factor (1 = no change, needs 3 or 4 channels)
+* @param state if not 0, the progress is reported and an empty Mat is returned if it is aborted
+* @param blurMode blur_box or blur_bokeh
+* @return the blurred image
+**/
+cv::Mat DkMiniaturesFilter::blurPanTilt(const cv::Mat& src, const DkFocusModel& focus, int maxKernel, float satFactor, DkFilterState* state, int blurMode) {
+
+	cv::Mat dst;
+
+	if (!blurPanTilt(src, dst, focus, maxKernel, satFactor, state, blurMode))
+		return cv::Mat();
+
+	return dst;
+}
+
+/**
+* Blurs an image and writes the result to dst.
+* dst is only allocated if its size or type does not match src - so it can wrap a preallocated QImage.
+* @param src the input image (CV_8U | CV_16U | CV_32F with 1, 3 or 4 channels)
+* @param dst the output image - it must not share data with src
+* @param focus the focus model which provides the blur amount (0 = in focus, 1 = maximal blur)
+* @param maxKernel the maximal blur kernel size
+* @param satFactor the saturation is multiplied by this factor (1 = no change, needs 3 or 4 channels)
+* @param state if not 0, the progress is reported and false is returned if it is aborted
+* @param blurMode blur_box or blur_bokeh
+* @return false if the filter was aborted
+**/
+bool DkMiniaturesFilter::blurPanTilt(const cv::Mat& src, cv::Mat& dst, const DkFocusModel& focus, int maxKernel, float satFactor, DkFilterState* state, int blurMode) {
+
+	int depth = src.depth();
+
+	dst.create(src.size(), src.type());	// each pixel is written by exactly one level
+
+	if (src.empty() || (depth != CV_8U && depth != CV_16U && depth != CV_32F) || src.channels() > 4 || focus.size() != QSize(src.cols, src.rows)) {
+		src.copyTo(dst);
+		return true;
+	}
+
+	QVector<int> radii = levelRadii(maxKernel);
+	float radiusScale = maxKernel*0.5f;
+
+	cv::Mat lower;
+	cv::Mat upper;
+
+	// a blur and a blend pass per level
+	if (state) {
+		int total = (radii.size()-1) * numBands(src.rows);
+		for (int idx = 1; idx < radii.size(); idx++)
+			total += (blurMode == blur_bokeh) ? discTiles(src.size(), radii[idx]).size() : numBands(src.rows);
+		state->total.store(total);
+	}
+
+	for (int idx = 1; idx < radii.size(); idx++) {
+
+		if (blurMode == blur_bokeh)
+			discBlur(src, upper, radii[idx], state);
+		else
+			boxBlur(src, upper, radii[idx], state);
+
+		parallelRows(src.rows, [&](int firstRow, int lastRow) {
+			if (depth == CV_8U)
+				blendRows<unsigned char>(src, lower, upper, focus, dst, radiusScale, radii, idx, satFactor, firstRow, lastRow);
+			else if (depth == CV_16U)
+				blendRows<unsigned short>(src, lower, upper, focus, dst, radiusScale, radii, idx, satFactor, firstRow, lastRow);
+			else
+				blendRows<float>(src, lower, upper, focus, dst, radiusScale, radii, idx, satFactor, firstRow, lastRow);
+		}, state);
+
+		if (state && state->isAborted())
+			return false;
+
+		cv::swap(lower, upper);
+	}
+
+	return true;
+}
+
+/**
+* @return the cv::Mat type that matches the QImage format or -1 if the format cannot be wrapped
+**/
+int DkMiniaturesFilter::matType(QImage::Format format) {
+
+	switch (format) {
+	case QImage::Format_ARGB32:
+	case QImage::Format_RGB32:
+		return CV_8UC4;
+	case QImage::Format_RGB888:
+		return CV_8UC3;
+	case QImage::Format_Indexed8:
+		return CV_8UC1;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	case QImage::Format_RGBA64:
+	case QImage::Format_RGBX64:
+		return CV_16UC4;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	case QImage::Format_Grayscale16:
+		return CV_16UC1;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+	case QImage::Format_RGBA32FPx4:
+	case QImage::Format_RGBX32FPx4:
+		return CV_32FC4;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/**
+* Converts an image to a format that can be wrapped by a cv::Mat.
+* 16 bit (Qt >= 5.12) and float (Qt >= 6.2) images keep their depth, all other formats are converted to ARGB32.
+* @param img the image
+* @return img (shared, not copied) if its format is supported, a converted copy otherwise
+**/
+QImage DkMiniaturesFilter::toSupportedFormat(const QImage& img) {
+
+	if (matType(img.format()) != -1)
+		return img;
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+	if (img.format() == QImage::Format_RGBA32FPx4_Premultiplied || img.format() == QImage::Format_RGBA16FPx4 || 
+		img.format() == QImage::Format_RGBX16FPx4 || img.format() == QImage::Format_RGBA16FPx4_Premultiplied)
+		return img.convertToFormat(QImage::Format_RGBA32FPx4);
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	if (img.format() == QImage::Format_RGBA64_Premultiplied)
+		return img.convertToFormat(QImage::Format_RGBA64);
+#endif
+
+	return img.convertToFormat(QImage::Format_ARGB32);
+}
+
+/**
+* Wraps the scanlines of an image without copying.
+* The Mat is only valid as long as img is not modified or destroyed and it must not be written.
+* @param img an image with a supported format (see toSupportedFormat)
+* @return the Mat header or an empty Mat if the format is not supported
+**/
+cv::Mat DkMiniaturesFilter::wrapImage(const QImage& img) {
+
+	int type = matType(img.format());
+
+	if (img.isNull() || type == -1)
+		return cv::Mat();
+
+	return cv::Mat(img.height(), img.width(), type, (uchar*)img.constBits(), img.bytesPerLine());
+}
+
+/**
+* Wraps the scanlines of an image without copying - the Mat can be written.
+* img is detached if its data is shared.
+* @param img an image with a supported format (see toSupportedFormat)
+* @return the Mat header or an empty Mat if the format is not supported
+**/
+cv::Mat DkMiniaturesFilter::wrapImage(QImage& img) {
+
+	int type = matType(img.format());
+
+	if (img.isNull() || type == -1)
+		return cv::Mat();
+
+	return cv::Mat(img.height(), img.width(), type, img.bits(), img.bytesPerLine());
+}
+
+/**
+* Converts a QImage to a Mat
+* 16 bit (Qt >= 5.12) and float (Qt >= 6.2) images keep their depth.
+* @param img formats supported: ARGB32 | RGB32 | RGB888 | Indexed8 | RGBA64 | Grayscale16 | RGBA32FPx4 (others are converted)
+* @return cv::Mat the corresponding Mat (which owns its data)
+**/ 
+cv::Mat DkMiniaturesFilter::qImage2Mat(const QImage img) {
+
+	return wrapImage(toSupportedFormat(img)).clone();	// we need to own the pointer
+}
+
+/**
+* Converts a cv::Mat to a QImage.
+* @param img supported formats CV8UC1 | CV_8UC3 | CV_8UC4 | CV_16UC1 | CV_16UC4 | CV_32FC4
+* @return QImage the corresponding QImage
+**/ 
+QImage DkMiniaturesFilter::mat2QImage(cv::Mat img) {
+
+	QImage qImg;
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+	if (img.type() == CV_16UC4)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_RGBA64);
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+	if (img.type() == CV_16UC1)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_Grayscale16);
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+	if (img.type() == CV_32FC4)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_RGBA32FPx4);
+#endif
+
+	if (!qImg.isNull())
+		return qImg.copy();
+
+	// since cv::Mat header is copied, a new buffer should be allocated (check this!)
+	if (img.depth() == CV_32F)
+		img.convertTo(img, CV_8U, 255);
+	else if (img.depth() == CV_16U)
+		img.convertTo(img, CV_8U, 1.0/257.0);
+
+	if (img.type() == CV_8UC1)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_Indexed8);	// opencv uses size_t if for scaling in x64 applications
+	if (img.type() == CV_8UC3)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_RGB888);
+	if (img.type() == CV_8UC4)
+		qImg = QImage(img.data, (int)img.cols, (int)img.rows, (int)img.step, QImage::Format_ARGB32);
+
+	qImg = qImg.copy();
+
+	return qImg;
+}
+
+/**
+* Mean filter with a (2*radius+1)x(2*radius+1) kernel.
+* The kernel is clipped at the image borders (i.e. only pixels within the image are averaged).
+* @param src the input image (CV_8U | CV_16U | CV_32F, interleaved channels)
+* @param dst the output image
+* @param radius the kernel radius
+* @param state if not 0, the progress is reported
+**/
+void DkMiniaturesFilter::boxBlur(const cv::Mat& src, cv::Mat& dst, int radius, DkFilterState* state) {
+
+	dst.create(src.size(), src.type());
+	int depth = src.depth();
+
+	parallelRows(src.rows, [&](int firstRow, int lastRow) {
+		if (depth == CV_8U)
+			boxBlurRows<unsigned char>(src, dst, radius, firstRow, lastRow);
+		else if (depth == CV_16U)
+			boxBlurRows<unsigned short>(src, dst, radius, firstRow, lastRow);
+		else
+			boxBlurRows<float>(src, dst, radius, firstRow, lastRow);
+	}, state);
+}
+
+/**
+* Lens blur with a disc kernel.
+* Highlights are boosted before the convolution so that bright spots turn into discs (bokeh).
+* The image is convolved tile by tile in the frequency domain. Each tile is padded by the kernel radius,
+* hence the FFT buffers are bounded by the tile size and the tiles are processed in parallel.
+* @param src the input image (CV_8U | CV_16U | CV_32F, interleaved channels)
+* @param dst the output image
+* @param radius the disc radius
+* @param state if not 0, the progress is reported - tiles are skipped if it is aborted
+**/
+void DkMiniaturesFilter::discBlur(const cv::Mat& src, cv::Mat& dst, int radius, DkFilterState* state) {
+
+	dst.create(src.size(), src.type());
+
+	QVector<QRect> tiles = discTiles(src.size(), radius);
+
+	if (tiles.isEmpty())
+		return;
+
+	int tileSize = qMax(tiles[0].width(), tiles[0].height());
+	cv::Mat kernelSpec = discSpectrum(radius, cv::getOptimalDFTSize(tileSize + 2*radius));
+	int depth = src.depth();
+
+	auto processTile = [&](const QRect& tile) {
+
+		if (state && state->isAborted())
+			return;
+
+		if (depth == CV_8U)
+			discBlurTile<unsigned char>(src, dst, kernelSpec, radius, tile);
+		else if (depth == CV_16U)
+			discBlurTile<unsigned short>(src, dst, kernelSpec, radius, tile);
+		else
+			discBlurTile<float>(src, dst, kernelSpec, radius, tile);
+
+		if (state)
+			state->done.fetchAndAddRelaxed(1);
+	};
+
+	QtConcurrent::blockingMap(tiles, processTile);
+}
+
+/**
+* @return the output tiles of the disc blur (all tiles have the same size except at the right and bottom border)
+**/
+QVector<QRect> DkMiniaturesFilter::discTiles(const cv::Size& size, int radius) {
+
+	// the padding should not dominate the FFT size
+	int tileSize = qMax(DK_BOKEH_TILE, radius * 4);
+
+	QVector<QRect> tiles;
+	for (int y = 0; y < size.height; y += tileSize)
+		for (int x = 0; x < size.width; x += tileSize)
+			tiles << QRect(x, y, qMin(tileSize, size.width - x), qMin(tileSize, size.height - y));
+
+	return tiles;
+}
+
+/**
+* Returns the spectrum of a normalized disc kernel.
+* The kernel is centered at the origin (wrapped around) so that the convolution result is not shifted.
+* The disc border is anti-aliased.
+* @param radius the disc radius
+* @param dftSize the width and height of the spectrum
+* @return the spectrum (CV_32FC1, CCS packed)
+**/
+cv::Mat DkMiniaturesFilter::discSpectrum(int radius, int dftSize) {
+
+	cv::Mat kernel = cv::Mat::zeros(dftSize, dftSize, CV_32FC1);
+	double sum = 0;
+
+	for (int dy = -radius; dy <= radius; dy++) {
+
+		float* kPtr = kernel.ptr<float>((dy + dftSize) % dftSize);
+
+		for (int dx = -radius; dx <= radius; dx++) {
+			float w = qBound(0.0f, radius + 0.5f - std::sqrt((float)(dx*dx + dy*dy)), 1.0f);
+			kPtr[(dx + dftSize) % dftSize] = w;
+			sum += w;
+		}
+	}
+
+	kernel *= 1.0 / sum;
+
+	cv::Mat spec;
+	cv::dft(kernel, spec);
+
+	return spec;
+}
+
+/**
+* Convolves one tile with the disc kernel.
+* The tile is padded by the kernel radius (border pixels are replicated), so no wrap around reaches the output.
+* Highlights are amplified quadratically above DK_BOKEH_THRESHOLD and clipped after the convolution.
+* Hence, float images are clipped to [0 1] in this mode.
+**/
+template <typename T>
+void DkMiniaturesFilter::discBlurTile(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernelSpec, int radius, const QRect& tile) {
+
+	int dftSize = kernelSpec.rows;
+	int cn = src.channels();
+	int colorChannels = qMin(cn, 3);	// alpha is not boosted
+
+	float maxVal = DkBlurTraits<T>::maxValue();
+	float thr = DK_BOKEH_THRESHOLD * maxVal;
+	float boostScale = DK_BOKEH_BOOST / ((maxVal - thr) * (maxVal - thr));
+
+	std::vector<int> srcCols(dftSize);
+	for (int x = 0; x < dftSize; x++)
+		srcCols[x] = qBound(0, tile.x() - radius + x, src.cols - 1) * cn;
+
+	cv::Mat plane(dftSize, dftSize, CV_32FC1);
+	cv::Mat planeSpec;
+
+	for (int ch = 0; ch < cn; ch++) {
+
+		for (int y = 0; y < dftSize; y++) {
+
+			const T* srcPtr = src.ptr<T>(qBound(0, tile.y() - radius + y, src.rows - 1)) + ch;
+			float* pPtr = plane.ptr<float>(y);
+
+			if (ch < colorChannels) {
+				for (int x = 0; x < dftSize; x++) {
+					float v = (float)srcPtr[srcCols[x]];
+					float h = qMax(v - thr, 0.0f);
+					pPtr[x] = v * (1.0f + boostScale * h * h);
+				}
+			}
+			else {
+				for (int x = 0; x < dftSize; x++)
+					pPtr[x] = (float)srcPtr[srcCols[x]];
+			}
+		}
+
+		cv::dft(plane, planeSpec);
+		cv::mulSpectrums(planeSpec, kernelSpec, planeSpec, 0);
+		cv::dft(planeSpec, plane, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+
+		// boosted highlights are clipped
+		for (int y = 0; y < tile.height(); y++) {
+
+			const float* pPtr = plane.ptr<float>(y + radius) + radius;
+			T* dstPtr = dst.ptr<T>(tile.y() + y) + tile.x()*cn + ch;
+
+			for (int x = 0; x < tile.width(); x++)
+				dstPtr[x*cn] = DkBlurTraits<T>::fromFloat(qBound(0.0f, pPtr[x], maxVal));
+		}
+	}
+}
+
+/**
+* Returns the radii of all blur levels.
+* The first level is the source image, the second level has radius 2 which is the smallest kernel of the filter.
+* @param maxKernel the maximal blur kernel size
+* @return the radii in ascending order
+**/
+QVector<int> DkMiniaturesFilter::levelRadii(int maxKernel) {
+
+	int maxRadius = qMax(qRound(maxKernel*0.5f), 2);
+	int numLevels = qBound(1, qCeil((maxRadius - 2) / DK_LEVEL_STEP) + 1, DK_MAX_BLUR_LEVELS);
+
+	QVector<int> radii;
+	radii << 0 << 2;
+
+	for (int idx = 1; idx < numLevels; idx++) {
+		int r = 2 + qRound((maxRadius - 2) * idx / (double)(numLevels - 1));
+		if (r > radii.last())
+			radii << r;
+	}
+
+	return radii;
+}
+
+/**
+* @return the number of row bands used by parallelRows
+**/
+int DkMiniaturesFilter::numBands(int rows) {
+
+	return qBound(1, rows / DK_MIN_BAND_HEIGHT, QThread::idealThreadCount() * 4);
+}
+
+/**
+* Splits the rows into bands which are processed in parallel.
+* @param rows the number of rows
+* @param fnc the function that processes the rows [firstRow lastRow)
+* @param state if not 0, each band increments its progress - bands are skipped if it is aborted
+**/
+void DkMiniaturesFilter::parallelRows(int rows, const std::function<void(int, int)>& fnc, DkFilterState* state) {
+
+	int bandHeight = qCeil(rows / (double)numBands(rows));
+
+	QVector<QPair<int, int> > bands;
+	for (int y = 0; y < rows; y += bandHeight)
+		bands << qMakePair(y, qMin(y + bandHeight, rows));
+
+	auto processBand = [&](const QPair<int, int>& band) {
+
+		if (state && state->isAborted())
+			return;
+
+		fnc(band.first, band.second);
+
+		if (state)
+			state->done.fetchAndAddRelaxed(1);
+	};
+
+	if (bands.size() == 1)
+		processBand(bands[0]);
+	else
+		QtConcurrent::blockingMap(bands, processBand);
+}
+
+/**
+* Computes the box blur of a row band.
+* A vertical pass with running column sums is followed by a horizontal pass on the column sums' prefix sums.
+* Channels stay interleaved and both inner loops run over contiguous arrays so that they can be vectorized by the compiler.
+**/
+template <typename T>
+void DkMiniaturesFilter::boxBlurRows(const cv::Mat& src, cv::Mat& dst, int radius, int firstRow, int lastRow) {
+
+	typedef typename DkBlurTraits<T>::sum_type sum_type;
+
+
+	int cn = src.channels();
+	int cols = src.cols;
+	int rows = src.rows;
+	int rowLength = cols * cn;
+
+	std::vector<sum_type> colSum(rowLength, 0);
+	std::vector<sum_type> prefix(rowLength + cn, 0);
+	std::vector<float> invCols(cols);
+
+	for (int cIdx = 0; cIdx < cols; cIdx++)
+		invCols[cIdx] = 1.0f / (qMin(cIdx + radius, cols - 1) - qMax(cIdx - radius, 0) + 1);
+
+	// initialize the column sums for the first row
+	for (int rIdx = qMax(firstRow - radius, 0); rIdx <= qMin(firstRow + radius, rows - 1); rIdx++) {
+		const T* srcPtr = src.ptr<T>(rIdx);
+		for (int idx = 0; idx < rowLength; idx++)
+			colSum[idx] += srcPtr[idx];
+	}
+
+	for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+
+		if (rIdx > firstRow) {
+
+			int addRow = rIdx + radius;
+			int remRow = rIdx - radius - 1;
+
+			if (addRow < rows) {
+				const T* addPtr = src.ptr<T>(addRow);
+				for (int idx = 0; idx < rowLength; idx++)
+					colSum[idx] += addPtr[idx];
+			}
+			if (remRow >= 0) {
+				const T* remPtr = src.ptr<T>(remRow);
+				for (int idx = 0; idx < rowLength; idx++)
+					colSum[idx] -= remPtr[idx];
+			}
+		}
+
+		// prefix[(c+1)*cn + ch] is the sum of colSum[0..c] of channel ch
+		for (int idx = 0; idx < rowLength; idx++)
+			prefix[idx + cn] = prefix[idx] + colSum[idx];
+
+		float invRows = 1.0f / (qMin(rIdx + radius, rows - 1) - qMax(rIdx - radius, 0) + 1);
+		T* dstPtr = dst.ptr<T>(rIdx);
+
+		for (int cIdx = 0; cIdx < cols; cIdx++) {
+
+			int left = qMax(cIdx - radius, 0) * cn;
+			int right = qMin(cIdx + radius + 1, cols) * cn;
+			float invArea = invCols[cIdx] * invRows;
+
+			for (int ch = 0; ch < cn; ch++)
+				dstPtr[cIdx*cn + ch] = DkBlurTraits<T>::fromFloat((float)(prefix[right + ch] - prefix[left + ch]) * invArea);
+		}
+	}
+}
+
+/**
+* Writes all pixels whose kernel radius is within (radii[level-1] radii[level]] to dst.
+* The first level additionally writes the in focus pixels and the last level all pixels above its radius.
+* The two blur levels are blended linearly and the saturation of the result is boosted.
+**/
+template <typename T>
+void DkMiniaturesFilter::blendRows(const cv::Mat& src, const cv::Mat& lower, const cv::Mat& upper, const DkFocusModel& focus, cv::Mat& dst, 
+	float radiusScale, const QVector<int>& radii, int level, float satFactor, int firstRow, int lastRow) {
+
+	int cn = dst.channels();
+	bool isFirst = level == 1;
+	bool isLast = level == radii.size() - 1;
+	bool saturate = satFactor > 1.0f && cn >= 3;
+
+	float lowerRadius = (float)radii[level-1];
+	float upperRadius = (float)radii[level];
+	float invRange = 1.0f / (upperRadius - lowerRadius);
+
+	// the depth is computed per row - no distance map is stored
+	std::vector<float> depth(dst.cols);
+	const float* depthPtr = depth.data();
+
+	for (int rIdx = firstRow; rIdx < lastRow; rIdx++) {
+
+		focus.depthRow(rIdx, depth.data());
+		const T* srcPtr = src.ptr<T>(rIdx);
+		const T* upperPtr = upper.ptr<T>(rIdx);
+		const T* lowerPtr = (isFirst) ? 0 : lower.ptr<T>(rIdx);
+		T* dstPtr = dst.ptr<T>(rIdx);
+
+		for (int cIdx = 0; cIdx < dst.cols; cIdx++) {
+
+			float r = depthPtr[cIdx] * radiusScale;
+
+			if ((r <= lowerRadius && !isFirst) || (r > upperRadius && !isLast))
+				continue;
+
+			int pIdx = cIdx*cn;
+
+			if (r <= 0.0f) {
+				for (int ch = 0; ch < cn; ch++)
+					dstPtr[pIdx + ch] = srcPtr[pIdx + ch];
+			}
+			else if (isFirst) {		// the smallest kernel has a radius of 2
+				for (int ch = 0; ch < cn; ch++)
+					dstPtr[pIdx + ch] = upperPtr[pIdx + ch];
+			}
+			else {
+				float alpha = qMin((r - lowerRadius) * invRange, 1.0f);
+				for (int ch = 0; ch < cn; ch++)
+					dstPtr[pIdx + ch] = DkBlurTraits<T>::fromFloat(lowerPtr[pIdx + ch] + alpha * ((float)upperPtr[pIdx + ch] - lowerPtr[pIdx + ch]));
+			}
+
+			if (saturate)
+				saturatePixel<T>(dstPtr + pIdx, satFactor);
+		}
+	}
+}
+
+/**
+* Multiplies the HSV saturation of a pixel while hue and value are kept.
+* With V = max and m = min, S' = min(S*f, 1) is reached by moving all channels away from V: c' = V - (V - c)*k, k = S'/S.
+* The channel order does not matter and the 4th channel (alpha) is not changed.
+* @param pixel the first three channels are modified
+* @param satFactor the saturation factor
+**/
+template <typename T>
+void DkMiniaturesFilter::saturatePixel(T* pixel, float satFactor) {
+
+	float maxVal = (float)qMax(qMax(pixel[0], pixel[1]), pixel[2]);
+	float minVal = (float)qMin(qMin(pixel[0], pixel[1]), pixel[2]);
+
+	if (maxVal <= minVal || maxVal <= 0.0f)
+		return;
+
+	// k = min(f, 1/S) with S = (V-m)/V
+	float k = qMin(satFactor, maxVal / (maxVal - minVal));
+
+	for (int ch = 0; ch < 3; ch++)
+		pixel[ch] = DkBlurTraits<T>::fromFloat(maxVal - (maxVal - pixel[ch]) * k);
+}
+
+#endif
+
+};
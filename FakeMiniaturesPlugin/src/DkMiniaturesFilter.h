@@ -0,0 +1,189 @@
+/*******************************************************************************************************
+ DkMiniaturesFilter.h
+ Created on:	19.10.2026
+ 
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+ 
+ Copyright (C) 2011-2013 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2013 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2013 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include <QAtomicInt>
+#include <QSize>
+#include <QPointF>
+#include <QSizeF>
+
+class QSettings;
+
+#include <functional>
+
+#ifdef WITH_OPENCV
+#include "opencv2/core/core.hpp"
+#endif
+
+namespace nmp {
+
+/**
+* Abort flag and progress of a running filter.
+* It is shared between the GUI thread and the worker threads.
+**/
+class DkFilterState {
+
+public:
+	DkFilterState() : aborted(0), done(0), total(0) {};
+
+	void abort() { aborted.store(1); };
+	bool isAborted() const { return aborted.load() != 0; };
+	int progress() const { return (total.load() > 0) ? qMin(done.load() * 100 / total.load(), 100) : 0; };
+
+	QAtomicInt aborted;
+	QAtomicInt done;	// processed row bands (or tiles)
+	QAtomicInt total;	// row bands (or tiles) of all passes
+};
+
+/**
+* Analytic depth model of the focus area.
+* The normalized blur amount [0 1] is computed row by row from a closed form distance,
+* so no full-size distance map is needed.
+**/
+class DkFocusModel {
+
+public:
+	enum {
+		focus_rect = 0,		// axis aligned rectangle (chessboard distance)
+		focus_band,			// rotated band with constant height
+		focus_ellipse,		// rotated ellipse
+
+		focus_end
+	};
+
+	DkFocusModel();
+
+	static DkFocusModel fromRect(const QRect& rect, const QSize& size, double falloff = 1.0);
+	static DkFocusModel fromBand(const QPointF& center, double height, double angle, const QSize& size, double falloff = 1.0);
+	static DkFocusModel fromEllipse(const QPointF& center, const QSizeF& radii, double angle, const QSize& size, double falloff = 1.0);
+
+	void depthRow(int row, float* dst) const;
+	QSize size() const { return imgSize; };
+
+protected:
+	void init(double angle, double falloff);
+	double distance(double x, double y) const;
+
+	int type;
+	QSize imgSize;
+	QRect rect;
+	QPointF center;
+	QSizeF radii;			// ellipse radii or (0, height/2) for a band
+	double cosA;
+	double sinA;
+	double falloff;
+	double invMaxDist;
+	QVector<float> colDist;	// horizontal distance of each column (focus_rect)
+};
+
+/**
+* Parameters of the fake miniatures filter that do not depend on the image size.
+* They are stored in the settings so that the batch mode uses the values of the last interactive run.
+**/
+class DkMiniaturesParams {
+
+public:
+	DkMiniaturesParams();
+
+	DkFocusModel focusModel(const QSize& size) const;
+	int kernelSize(const QSize& size) const;
+
+	void loadSettings(QSettings& settings);
+	void saveSettings(QSettings& settings) const;
+
+	double focusTop;		// focus band relative to the image height [0 1]
+	double focusBottom;
+	double focusAngle;		// rotation of the focus area around its center in degrees
+	int focusShape;			// DkFocusModel::focus_band | DkFocusModel::focus_ellipse
+	int maxKernel;			// maximal blur kernel size in pixels, 0 = 2% of the image diagonal
+	int saturation;			// saturation boost [0 100]
+	double falloff;			// the blur radius is proportional to distance^falloff (1 = linear)
+	int blurMode;			// DkMiniaturesFilter::blur_box | DkMiniaturesFilter::blur_bokeh
+	int maxMemory;			// memory budget of parallel batch jobs in MB
+};
+
+/**
+* The blur engine of the fake miniatures filter.
+* The depth of the focus model is quantized into a few blur levels. Each level is a separable box blur
+* (O(1) per pixel, independent of the kernel size) and neighboring levels are blended linearly.
+* Channels are kept interleaved and all passes work on row bands which are processed in parallel.
+* The bokeh mode replaces the box blur by a disc (lens) kernel which is convolved in the frequency domain.
+* 8 bit, 16 bit and float images are processed natively.
+**/
+class DkMiniaturesFilter {
+
+public:
+	enum {
+		blur_box = 0,		// fast box blur
+		blur_bokeh,			// disc kernel with highlight boost (FFT)
+
+		blur_end
+	};
+
+	static QImage apply(const QImage& img, const QRect& focusRect, int kernelSize, int saturation, DkFilterState* state = 0, int blurMode = blur_box);
+	static QImage apply(const QImage& img, const DkMiniaturesParams& params, DkFilterState* state = 0);
+	static QImage apply(const QImage& img, const DkFocusModel& focus, int kernelSize, int saturation, DkFilterState* state = 0, int blurMode = blur_box);
+	static bool apply(const QImage& img, QImage& dst, const DkFocusModel& focus, int kernelSize, int saturation, DkFilterState* state = 0, int blurMode = blur_box);
+	static int memoryUsage(const QSize& size, int depth = 32);
+
+#ifdef WITH_OPENCV
+	static cv::Mat blurPanTilt(const cv::Mat& src, const DkFocusModel& focus, int maxKernel, float satFactor = 1.0f, DkFilterState* state = 0, int blurMode = blur_box);
+	static bool blurPanTilt(const cv::Mat& src, cv::Mat& dst, const DkFocusModel& focus, int maxKernel, float satFactor = 1.0f, DkFilterState* state = 0, int blurMode = blur_box);
+	static void boxBlur(const cv::Mat& src, cv::Mat& dst, int radius, DkFilterState* state = 0);
+	static void discBlur(const cv::Mat& src, cv::Mat& dst, int radius, DkFilterState* state = 0);
+	static QVector<int> levelRadii(int maxKernel);
+
+	static int numBands(int rows);
+	static QVector<QRect> discTiles(const cv::Size& size, int radius);
+	static void parallelRows(int rows, const std::function<void(int, int)>& fnc, DkFilterState* state = 0);
+
+	// zero-copy bridge: QImage scanlines are wrapped by a cv::Mat header
+	static int matType(QImage::Format format);
+	static QImage toSupportedFormat(const QImage& img);
+	static cv::Mat wrapImage(const QImage& img);
+	static cv::Mat wrapImage(QImage& img);
+
+	static cv::Mat qImage2Mat(const QImage img);
+	static QImage mat2QImage(cv::Mat img);
+
+protected:
+	static cv::Mat discSpectrum(int radius, int dftSize);
+
+	// the kernels are instantiated for unsigned char, unsigned short and float
+	template <typename T> static void boxBlurRows(const cv::Mat& src, cv::Mat& dst, int radius, int firstRow, int lastRow);
+	template <typename T> static void discBlurTile(const cv::Mat& src, cv::Mat& dst, const cv::Mat& kernelSpec, int radius, const QRect& tile);
+	template <typename T> static void blendRows(const cv::Mat& src, const cv::Mat& lower, const cv::Mat& upper, const DkFocusModel& focus, cv::Mat& dst, 
+		float radiusScale, const QVector<int>& radii, int level, float satFactor, int firstRow, int lastRow);
+	template <typename T> static void saturatePixel(T* pixel, float satFactor);
+#endif
+};
+
+};
@@ -0,0 +1,521 @@
+/*******************************************************************************************************
+ DkThresholdBenchmark.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkThresholdBenchmark.h"
+#include "DkThresholdUtils.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QFuture>
+#include <QtConcurrentRun>
+
+#include <cmath>
+
+namespace nmp {
+
+/**
+* Verifies all formats and channels and measures the throughput.
+* @param size the width and height of the benchmark images
+* @param iterations the number of runs per measurement
+* @return true if all kernels match the reference
+**/
+bool DkThresholdBenchmark::run(int size, int iterations) {
+
+	bool ok = true;
+	QVector<QImage::Format> fmts = formats();
+
+	// odd sizes so that the SIMD tails are covered
+	for (int fIdx = 0; fIdx < fmts.size(); fIdx++) {
+
+		QImage::Format f = fmts[fIdx];
+		QImage img = createImage(259, 67, f);
+
+		for (int ch = channel_gray; ch <= channel_blue; ch++) {
+			for (int of = output_rgb; of < output_end; of++) {
+				if (!verify(img, ch, 60, 190, of)) {
+					qWarning() << "[Threshold Benchmark]" << formatName(f) << "channel" << ch << "output" << of << "FAILED";
+					ok = false;
+				}
+			}
+		}
+	}
+
+	// color spaces: the second image has more than DK_THR_BAND_PIXELS pixels so that the band seams are covered
+	int hsvWrapped[2][3] = {{200, 40, 30}, {30, 255, 230}};	// the hue band wraps around red
+	int hsv[2][3] = {{60, 0, 50}, {170, 200, 255}};
+	int lab[2][3] = {{40, 100, 90}, {200, 160, 170}};
+
+	QVector<QImage> cImgs;
+	cImgs << createImage(259, 67, QImage::Format_ARGB32_Premultiplied) << createImage(1031, 1050, QImage::Format_RGB888);
+
+	if (!verifyGoldenColors()) {
+		qWarning() << "[Threshold Benchmark] golden colors FAILED";
+		ok = false;
+	}
+
+	for (int iIdx = 0; iIdx < cImgs.size(); iIdx++) {
+
+		if (!verifyConversion(cImgs[iIdx], channel_hsv) || !verifyConversion(cImgs[iIdx], channel_lab)) {
+			qWarning() << "[Threshold Benchmark] color space conversion of image" << iIdx << "FAILED";
+			ok = false;
+		}
+
+		// the whole image converted at once is the reference for the banded threshold (the conversion is checked above)
+		QImage hsvRef = DkThresholdUtils::convertColorSpace(cImgs[iIdx], channel_hsv);
+		QImage labRef = DkThresholdUtils::convertColorSpace(cImgs[iIdx], channel_lab);
+
+		for (int of = output_rgb; of < output_end; of++) {
+			if (!verifyColorSpace(cImgs[iIdx], hsvRef, channel_hsv, hsvWrapped[0], hsvWrapped[1], of) ||
+				!verifyColorSpace(cImgs[iIdx], hsvRef, channel_hsv, hsv[0], hsv[1], of) ||
+				!verifyColorSpace(cImgs[iIdx], labRef, channel_lab, lab[0], lab[1], of)) {
+				qWarning() << "[Threshold Benchmark] color space threshold of image" << iIdx << "output" << of << "FAILED";
+				ok = false;
+			}
+		}
+	}
+
+	qDebug() << "[Threshold Benchmark] kernels" << (ok ? "match" : "do NOT match") << "the reference";
+
+	QVector<int> threads;
+	for (int n = 1; n < QThread::idealThreadCount(); n *= 2)
+		threads << n;
+	threads << qMax(QThread::idealThreadCount(), 1);
+
+	for (int fIdx = 0; fIdx < fmts.size(); fIdx++) {
+
+		QImage img = createImage(size, size, fmts[fIdx]);
+
+		for (int tIdx = 0; tIdx < threads.size(); tIdx++) {
+			double mps = megaPixelsPerSecond(img, channel_gray, threads[tIdx], iterations);
+			qDebug().nospace() << "[Threshold Benchmark] " << formatName(fmts[fIdx]) << " " << threads[tIdx] << " thread(s): " << mps << " MPixel/s";
+		}
+	}
+
+	return ok;
+}
+
+/**
+* Compares DkThresholdUtils::thresholdImage to the QImage::pixel() reference.
+* @param img the synthetic image
+* @param channel channel_gray | channel_red | channel_green | channel_blue
+* @param lower the lower threshold
+* @param upper the upper threshold
+* @param outputFormat output_rgb | output_mono
+* @return true if all pixels are equal
+**/
+bool DkThresholdBenchmark::verify(const QImage& img, int channel, int lower, int upper, int outputFormat) {
+
+	QImage dst = DkThresholdUtils::thresholdImage(img, channel, lower, upper, true, outputFormat);
+
+	if (dst.size() != img.size())
+		return false;
+
+	bool mono = outputFormat == output_mono;
+	if (mono && dst.format() != QImage::Format_MonoLSB)
+		return false;
+
+	for (int y = 0; y < img.height(); y++) {
+		for (int x = 0; x < img.width(); x++) {
+
+			int v = referenceValue(img, x, y, channel);
+			bool inside = v >= lower && v <= upper;
+
+			if (mono) {
+				if (dst.pixelIndex(x, y) != (inside ? 1 : 0))
+					return false;
+			}
+			else {
+				QRgb p = dst.pixel(x, y);
+				if (qRed(p) != (inside ? 255 : 0) || qRed(p) != qGreen(p) || qRed(p) != qBlue(p))
+					return false;
+				if (dst.hasAlphaChannel() && qAlpha(p) != qAlpha(img.pixel(x, y)))
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+* Compares DkThresholdUtils::convertColorSpace to the scalar formulas (see referenceColor).
+* OpenCV converts 8 bit images with fixed point arithmetic, so small deviations are allowed.
+* @param img the synthetic image
+* @param channel channel_hsv | channel_lab
+* @return true if all pixels are within the tolerance
+**/
+bool DkThresholdBenchmark::verifyConversion(const QImage& img, int channel) {
+
+	QImage cImg = DkThresholdUtils::convertColorSpace(img, channel);
+
+	// the color space is computed from the RGB values the plugin sees (i.e. premultiplied colors stay premultiplied)
+	QImage rgb = img.convertToFormat(QImage::Format_RGB888);
+
+	if (cImg.isNull() || cImg.size() != rgb.size() || cImg.format() != QImage::Format_RGB888)
+		return false;
+
+	double tolerance = (channel == channel_hsv) ? 1.0 : 2.0;
+
+	for (int y = 0; y < rgb.height(); y++) {
+
+		const uchar* sLine = rgb.constScanLine(y);
+		const uchar* cLine = cImg.constScanLine(y);
+
+		for (int x = 0; x < rgb.width() * 3; x += 3) {
+
+			double c[3];
+			referenceColor(sLine[x], sLine[x + 1], sLine[x + 2], channel, c);
+
+			// the hue of gray values is undefined
+			bool hue = channel == channel_hsv && c[1] > 0;
+
+			if ((hue || channel == channel_lab) && !isClose(cLine[x], c[0], tolerance, channel == channel_hsv))
+				return false;
+			if (!isClose(cLine[x + 1], c[1], tolerance) || !isClose(cLine[x + 2], c[2], tolerance))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+* Converts a few colors with known HSV | Lab values.
+* These catch a wrong conversion code or scaling even if the formulas of referenceColor had the same error.
+* @return true if all colors match their values (+/- 1)
+**/
+bool DkThresholdBenchmark::verifyGoldenColors() {
+
+	// r, g, b -> H (full range), S, V
+	const int hsvColors[][6] = {
+		{255,   0,   0,    0, 255, 255},
+		{  0, 255,   0,   85, 255, 255},
+		{  0,   0, 255,  171, 255, 255},
+		{255, 255,   0,   43, 255, 255},
+		{255, 128,   0,   21, 255, 255},
+		{128, 128, 128,    0,   0, 128}};
+
+	// r, g, b -> L (scaled to 255), a + 128, b + 128 (sRGB, D65)
+	const int labColors[][6] = {
+		{255, 255, 255,  255, 128, 128},
+		{  0,   0,   0,    0, 128, 128},
+		{255,   0,   0,  136, 208, 195},
+		{  0, 255,   0,  224,  42, 211},
+		{  0,   0, 255,   82, 207,  20},
+		{128, 128, 128,  137, 128, 128}};
+
+	int numColors = sizeof(hsvColors) / sizeof(hsvColors[0]);
+	QImage hsvImg(numColors, 1, QImage::Format_RGB888);
+	QImage labImg(numColors, 1, QImage::Format_RGB888);
+
+	for (int idx = 0; idx < numColors; idx++) {
+		hsvImg.setPixel(idx, 0, qRgb(hsvColors[idx][0], hsvColors[idx][1], hsvColors[idx][2]));
+		labImg.setPixel(idx, 0, qRgb(labColors[idx][0], labColors[idx][1], labColors[idx][2]));
+	}
+
+	QImage hsv = DkThresholdUtils::convertColorSpace(hsvImg, channel_hsv);
+	QImage lab = DkThresholdUtils::convertColorSpace(labImg, channel_lab);
+
+	if (hsv.isNull() || lab.isNull())
+		return false;
+
+	for (int idx = 0; idx < numColors; idx++) {
+
+		const uchar* h = hsv.constScanLine(0) + idx * 3;
+		const uchar* l = lab.constScanLine(0) + idx * 3;
+
+		for (int cIdx = 0; cIdx < 3; cIdx++) {
+			if (!isClose(h[cIdx], hsvColors[idx][3 + cIdx], 1.0, cIdx == 0) || !isClose(l[cIdx], labColors[idx][3 + cIdx], 1.0)) {
+				qWarning() << "[Threshold Benchmark] golden color" << idx << "component" << cIdx << "HSV:" << h[cIdx] << "Lab:" << l[cIdx];
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+* Compares DkThresholdUtils::thresholdColorSpace to a per-pixel threshold of the converted image.
+* A pixel is inside if all components are inside their bands - the hue band wraps if lower > upper.
+* @param img the synthetic image
+* @param ref img converted to channel at once (see verifyConversion)
+* @param channel channel_hsv | channel_lab
+* @param lower the lower thresholds of the three components
+* @param upper the upper thresholds of the three components
+* @param outputFormat output_rgb | output_mono
+* @return true if all pixels are equal
+**/
+bool DkThresholdBenchmark::verifyColorSpace(const QImage& img, const QImage& ref, int channel, const int* lower, const int* upper, int outputFormat) {
+
+	QImage dst = DkThresholdUtils::thresholdColorSpace(img, channel, lower, upper, 0, true, outputFormat);
+
+	if (dst.size() != img.size() || ref.size() != img.size())
+		return false;
+
+	bool mono = outputFormat == output_mono;
+	if (mono && dst.format() != QImage::Format_MonoLSB)
+		return false;
+
+	for (int y = 0; y < ref.height(); y++) {
+
+		const uchar* line = ref.constScanLine(y);
+
+		for (int x = 0; x < ref.width(); x++, line += 3) {
+
+			bool inside = true;
+			for (int idx = 0; idx < 3; idx++) {
+
+				if (idx == 0 && channel == channel_hsv && lower[0] > upper[0])
+					inside &= line[0] >= lower[0] || line[0] <= upper[0];
+				else
+					inside &= line[idx] >= lower[idx] && line[idx] <= upper[idx];
+			}
+
+			if (mono) {
+				if (dst.pixelIndex(x, y) != (inside ? 1 : 0))
+					return false;
+			}
+			else {
+				QRgb p = dst.pixel(x, y);
+				if (qRed(p) != (inside ? 255 : 0) || qRed(p) != qGreen(p) || qRed(p) != qBlue(p))
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+/**
+* Measures the throughput of DkThresholdUtils::thresholdImage.
+* The image is split into row bands which are processed by numThreads threads.
+* @param img the input image
+* @param channel the threshold channel
+* @param numThreads the number of threads
+* @param iterations the number of runs (the fastest run is reported)
+* @return the throughput in megapixels per second
+**/
+double DkThresholdBenchmark::megaPixelsPerSecond(const QImage& img, int channel, int numThreads, int iterations) {
+
+	if (img.isNull() || numThreads < 1)
+		return 0.0;
+
+	// the bands are copied before timing
+	int bandHeight = qMax(1, img.height() / numThreads);
+	QVector<QImage> bands;
+	for (int y = 0; y < img.height(); y += bandHeight)
+		bands << img.copy(0, y, img.width(), qMin(bandHeight, img.height() - y));
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(numThreads);
+
+	qint64 best = -1;
+
+	for (int it = 0; it < iterations; it++) {
+
+		QElapsedTimer dt;
+		dt.start();
+
+		QVector<QFuture<QImage> > results;
+		for (int idx = 0; idx < bands.size(); idx++)
+			results << QtConcurrent::run(&pool, &DkThresholdBenchmark::thresholdBand, bands[idx], channel);
+
+		for (int idx = 0; idx < results.size(); idx++)
+			results[idx].waitForFinished();
+
+		qint64 ns = dt.nsecsElapsed();
+		if (best < 0 || ns < best)
+			best = ns;
+	}
+
+	if (best <= 0)
+		return 0.0;
+
+	return (double)img.width() * img.height() / (best * 1e-3);
+}
+
+/**
+* @return all formats that are checked (formats that are not supported by the row kernels are converted)
+**/
+QVector<QImage::Format> DkThresholdBenchmark::formats() {
+
+	QVector<QImage::Format> fmts;
+	fmts << QImage::Format_Mono
+		<< QImage::Format_Indexed8
+		<< QImage::Format_Grayscale8
+		<< QImage::Format_RGB16
+		<< QImage::Format_RGB555
+		<< QImage::Format_RGB888
+		<< QImage::Format_RGB32
+		<< QImage::Format_ARGB32
+		<< QImage::Format_ARGB32_Premultiplied
+		<< QImage::Format_RGBX8888
+		<< QImage::Format_RGBA8888;
+
+	return fmts;
+}
+
+/**
+* Creates a synthetic image in which every channel (and alpha) takes all 256 values.
+* The channels use different strides so that neighboring pixels differ and all hues are hit.
+* @param width the image width
+* @param height the image height
+* @param format the target format
+* @return the synthetic image
+**/
+QImage DkThresholdBenchmark::createImage(int width, int height, QImage::Format format) {
+
+	QImage img(width, height, QImage::Format_ARGB32);
+
+	for (int y = 0; y < height; y++) {
+
+		QRgb* line = (QRgb*)img.scanLine(y);
+
+		for (int x = 0; x < width; x++)
+			line[x] = qRgba((x * 7 + y) & 255, (x * 3 + y * 5) & 255, (x ^ (y * 11)) & 255, (x + y * 3) & 255);
+	}
+
+	return img.convertToFormat(format);
+}
+
+QString DkThresholdBenchmark::formatName(QImage::Format format) {
+
+	switch (format) {
+	case QImage::Format_Mono:					return "Mono";
+	case QImage::Format_Indexed8:				return "Indexed8";
+	case QImage::Format_Grayscale8:				return "Grayscale8";
+	case QImage::Format_RGB16:					return "RGB16";
+	case QImage::Format_RGB555:					return "RGB555";
+	case QImage::Format_RGB888:					return "RGB888";
+	case QImage::Format_RGB32:					return "RGB32";
+	case QImage::Format_ARGB32:					return "ARGB32";
+	case QImage::Format_ARGB32_Premultiplied:	return "ARGB32_Premultiplied";
+	case QImage::Format_RGBX8888:				return "RGBX8888";
+	case QImage::Format_RGBA8888:				return "RGBA8888";
+	default:									return QString("Format %1").arg(format);
+	}
+}
+
+QImage DkThresholdBenchmark::thresholdBand(const QImage& img, int channel) {
+
+	return DkThresholdUtils::thresholdImage(img, channel, 60, 190, true);
+}
+
+/**
+* The golden value - this is how the threshold plugin read pixels before the row kernels were added.
+**/
+int DkThresholdBenchmark::referenceValue(const QImage& img, int x, int y, int channel) {
+
+	QRgb p = img.pixel(x, y);
+
+	// 8 bit images only have a gray channel (the red entry of the color table)
+	if (img.depth() == 8)
+		return qRed(p);
+
+	switch (channel) {
+	case channel_red:	return qRed(p);
+	case channel_green:	return qGreen(p);
+	case channel_blue:	return qBlue(p);
+	default:			return qGray(p);
+	}
+}
+
+/**
+* Converts one color with the textbook formulas (in double precision and independent of OpenCV).
+* HSV: H in degrees is scaled to [0 256), S and V to [0 255] (OpenCV's RGB2HSV_FULL).
+* Lab: sRGB is linearized and converted to XYZ (D65), L is scaled to [0 255], a and b are shifted by 128.
+* @param r the red value
+* @param g the green value
+* @param b the blue value
+* @param channel channel_hsv | channel_lab
+* @param c returns the three components (not rounded)
+**/
+void DkThresholdBenchmark::referenceColor(int r, int g, int b, int channel, double* c) {
+
+	if (channel == channel_hsv) {
+
+		int v = qMax(r, qMax(g, b));
+		int diff = v - qMin(r, qMin(g, b));
+		double h = 0;
+
+		if (diff > 0) {
+			if (v == r)			h = 60.0 * (g - b) / diff;
+			else if (v == g)	h = 120.0 + 60.0 * (b - r) / diff;
+			else				h = 240.0 + 60.0 * (r - g) / diff;
+		}
+		if (h < 0)
+			h += 360.0;
+
+		c[0] = h * 256.0 / 360.0;
+		c[1] = (v > 0) ? 255.0 * diff / v : 0.0;
+		c[2] = v;
+		return;
+	}
+
+	double rgb[3] = {r / 255.0, g / 255.0, b / 255.0};
+	for (int idx = 0; idx < 3; idx++)
+		rgb[idx] = (rgb[idx] <= 0.04045) ? rgb[idx] / 12.92 : std::pow((rgb[idx] + 0.055) / 1.055, 2.4);
+
+	// XYZ normalized by the D65 white point
+	double xyz[3] = {
+		(0.412453 * rgb[0] + 0.357580 * rgb[1] + 0.180423 * rgb[2]) / 0.950456,
+		 0.212671 * rgb[0] + 0.715160 * rgb[1] + 0.072169 * rgb[2],
+		(0.019334 * rgb[0] + 0.119193 * rgb[1] + 0.950227 * rgb[2]) / 1.088754};
+
+	double f[3];
+	for (int idx = 0; idx < 3; idx++)
+		f[idx] = (xyz[idx] > 0.008856) ? std::pow(xyz[idx], 1.0 / 3.0) : 7.787 * xyz[idx] + 16.0 / 116.0;
+
+	double l = (xyz[1] > 0.008856) ? 116.0 * f[1] - 16.0 : 903.3 * xyz[1];
+
+	c[0] = l * 255.0 / 100.0;
+	c[1] = 500.0 * (f[0] - f[1]) + 128.0;
+	c[2] = 200.0 * (f[1] - f[2]) + 128.0;
+}
+
+/**
+* @param value the 8 bit value
+* @param reference the exact value
+* @param tolerance the maximal difference
+* @param circular if true, the values wrap at 256 (hue)
+* @return true if value is within the tolerance
+**/
+bool DkThresholdBenchmark::isClose(int value, double reference, double tolerance, bool circular) {
+
+	double diff = qAbs(value - reference);
+
+	if (circular)
+		diff = qMin(diff, 256.0 - diff);
+
+	return diff <= tolerance;
+}
+
+};
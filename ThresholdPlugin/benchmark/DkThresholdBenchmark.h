@@ -0,0 +1,64 @@
+/*******************************************************************************************************
+ DkThresholdBenchmark.h
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QString>
+
+namespace nmp {
+
+/**
+* Self check and benchmark of the threshold kernels (thresholdBenchmark executable).
+* Synthetic images are created in all QImage formats, the results of DkThresholdUtils
+* are compared to a per-pixel reference and the throughput is written to the debug output.
+**/
+class DkThresholdBenchmark {
+
+public:
+	static bool run(int size = 2048, int iterations = 5);
+
+	static bool verify(const QImage& img, int channel, int lower, int upper, int outputFormat);
+	static bool verifyConversion(const QImage& img, int channel);
+	static bool verifyGoldenColors();
+	static bool verifyColorSpace(const QImage& img, const QImage& ref, int channel, const int* lower, const int* upper, int outputFormat);
+	static double megaPixelsPerSecond(const QImage& img, int channel, int numThreads, int iterations);
+
+	static QVector<QImage::Format> formats();
+	static QImage createImage(int width, int height, QImage::Format format);
+	static QString formatName(QImage::Format format);
+
+protected:
+	static QImage thresholdBand(const QImage& img, int channel);
+	static int referenceValue(const QImage& img, int x, int y, int channel);
+	static void referenceColor(int r, int g, int b, int channel, double* c);
+	static bool isClose(int value, double reference, double tolerance, bool circular = false);
+};
+
+};
@@ -0,0 +1,52 @@
+/*******************************************************************************************************
+ main.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+
+#include "DkThresholdBenchmark.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+/**
+* Usage: thresholdBenchmark [size] [iterations]
+* @return 0 if all kernels match the reference
+**/
+int main(int argc, char *argv[]) {
+
+	QCoreApplication app(argc, argv);
+	QStringList args = app.arguments();
+
+	int size = args.size() > 1 ? args[1].toInt() : 2048;
+	int iterations = args.size() > 2 ? args[2].toInt() : 5;
+
+	if (size < 1 || iterations < 1) {
+		qWarning("usage: thresholdBenchmark [size] [iterations]");
+		return 2;
+	}
+
+	return nmp::DkThresholdBenchmark::run(size, iterations) ? 0 : 1;
+}
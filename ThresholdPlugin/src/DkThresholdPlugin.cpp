@@ -28,6 +28,11 @@
 #include "DkThresholdPlugin.h"
 
 #include <QMouseEvent>
+#include <QSettings>
+#include <QtCore/qmath.h>
+#include <QtConcurrentMap>
+
+#define PREVIEW_TILE_SIZE 256
 
 namespace nmp {
 
@@ -126,6 +131,9 @@ DkThresholdViewPort::DkThresholdViewPort(QWidget* parent, Qt::WindowFlags flags)
 
 DkThresholdViewPort::~DkThresholdViewPort() {
 
+	autoThrWatcher.cancel();
+	autoThrWatcher.waitForFinished();
+
 	// acitive deletion since the MainWindow takes ownership...
 	// if we have issues with this, we could disconnect all signals between viewport and toolbar too
 	// however, then we have lot's of toolbars in memory if the user opens the plugin again and again
@@ -145,16 +153,34 @@ void DkThresholdViewPort::init() {
 	thrEnabled = true;
 	thrValue = 128;
 	thrValueUpper = thrValue;	
+	thrOutputFormat = output_rgb;
+	thrComponent = 0;
+	for (int idx = 0; idx < 3; idx++) {
+		thrBandLower[idx] = 0;
+		thrBandUpper[idx] = 255;
+	}
 	origImg = QImage();
 	origImgSet = false;
 
+	QSettings settings;
+	settings.beginGroup("thresholdPlugin");
+	tiledPreview = settings.value("tiledPreview", true).toBool();
+	settings.endGroup();
+
+	tileCache.setMaxCost(64*1024*1024);	// bytes - a few screens
+
 	thresholdToolbar = new DkThresholdToolBar(tr("Threshold Toolbar"), this);
 
 	connect(thresholdToolbar, SIGNAL(thrChannelSignal(int)), this, SLOT(setThrChannel(int)));
+	connect(thresholdToolbar, SIGNAL(thrComponentSignal(int)), this, SLOT(setThrComponent(int)));
 	connect(thresholdToolbar, SIGNAL(thrValSignal(int)), this, SLOT(setThrValue(int)));
 	connect(thresholdToolbar, SIGNAL(thrValUpperSignal(int)), this, SLOT(setThrValueUpper(int)));
 	connect(thresholdToolbar, SIGNAL(calculateAutoThresholdSignal()), this, SLOT(calculateAutoThreshold()));
+	connect(&autoThrWatcher, SIGNAL(progressRangeChanged(int, int)), thresholdToolbar, SLOT(setAutoThrProgressRange(int, int)));
+	connect(&autoThrWatcher, SIGNAL(progressValueChanged(int)), thresholdToolbar, SLOT(setAutoThrProgress(int)));
+	connect(&autoThrWatcher, SIGNAL(finished()), this, SLOT(autoThresholdFinished()));
 	connect(thresholdToolbar, SIGNAL(thrEnabledSignal(bool)), this, SLOT(setThrEnabled(bool)));
+	connect(thresholdToolbar, SIGNAL(thrOutputFormatSignal(int)), this, SLOT(setThrOutputFormat(int)));
 	connect(thresholdToolbar, SIGNAL(panSignal(bool)), this, SLOT(setPanning(bool)));
 	connect(thresholdToolbar, SIGNAL(cancelSignal()), this, SLOT(discardChangesAndClose()));
 	connect(thresholdToolbar, SIGNAL(applySignal()), this, SLOT(applyChangesAndClose()));
@@ -200,186 +226,296 @@ void DkThresholdViewPort::mouseReleaseEvent(QMouseEvent *event) {
 
 void DkThresholdViewPort::paintEvent(QPaintEvent *event) {
 
+	if (tiledPreview) {
+		loadOriginalImage();
+
+		QPainter painter(this);
+		drawPreviewTiles(painter);
+		painter.end();
+	}
+
 	DkPluginViewPort::paintEvent(event);
 }
 
-QImage DkThresholdViewPort::getOriginalImage() {
-	
-	return origImg;
-}
+/**
+* Thresholds the tiles which are currently visible and draws them on top of the original image.
+* Tiles are taken from a downsampled level if the image is zoomed out and are cached
+* with their threshold values - so going back to a previous threshold is free.
+**/
+void DkThresholdViewPort::drawPreviewTiles(QPainter& painter) {
 
-QImage DkThresholdViewPort::getThresholdedImage(bool thrEnabled) {
+	if (origImg.isNull())
+		return;
 
+	QTransform t;
+	if (mImgMatrix)		t = *mImgMatrix;
+	if (mWorldMatrix)	t = t * (*mWorldMatrix);
 
-	if(parent() && !origImgSet) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) {
-			origImg = viewport->getImage();
-			origImgSet = true;
-		}
+	QRect visibleRect = t.inverted().mapRect(QRectF(rect())).toAlignedRect().intersected(origImg.rect());
+	if (visibleRect.isEmpty())
+		return;
+
+	// select the coarsest level that still has at least one image pixel per screen pixel
+	double scale = qSqrt(qAbs(t.determinant()));
+	int level = 0;
+	while (scale * (2 << level) <= 1.0 && (origImg.width() >> (level+1)) > PREVIEW_TILE_SIZE)
+		level++;
+
+	QImage levelImg = previewLevel(level);
+	QSharedPointer<DkColorSpaceCache> levelColor = DkThresholdUtils::isColorSpace(thrChannel) ? colorLevel(level) : QSharedPointer<DkColorSpaceCache>();
+	double fx = origImg.width() / (double)levelImg.width();
+	double fy = origImg.height() / (double)levelImg.height();
+
+	QRect levelRect(qFloor(visibleRect.left() / fx), qFloor(visibleRect.top() / fy), qCeil(visibleRect.width() / fx) + 1, qCeil(visibleRect.height() / fy) + 1);
+	levelRect = levelRect.intersected(levelImg.rect());
+
+	// all threshold parameters are part of the key
+	quint64 paramKey = ((quint64)level << 56) | ((quint64)thrChannel << 53) | ((quint64)thrEnabled << 52) | ((quint64)thrComponent << 50);
+	if (DkThresholdUtils::isColorSpace(thrChannel)) {
+		for (int idx = 0; idx < 3; idx++)
+			paramKey |= ((quint64)thrBandLower[idx] << (16*idx + 8)) | ((quint64)thrBandUpper[idx] << (16*idx));
 	}
+	else
+		paramKey |= ((quint64)thrValue << 8) | (quint64)thrValueUpper;
 
-	QImage thrImage = QImage(origImg);
+	// the visible bands are converted in parallel (once - the cache is kept if only the thresholds change)
+	if (levelColor)
+		levelColor->convertRows(levelRect.top(), levelRect.bottom());
 
-	switch (thrImage.depth()) {
-		case 8:
-			thrImage = QImage(origImg.size(), QImage::Format_RGB32);
+	painter.setWorldTransform(t);
+	painter.setRenderHint(QPainter::SmoothPixmapTransform, level > 0);
+	painter.fillRect(visibleRect, nmc::Settings::param().display().bgColor);
 
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int gray =  (thrEnabled) ? ((thrValue <= qRed(origImg.pixel(x, y)) && qRed(origImg.pixel(x, y)) <= thrValueUpper) ? 255 : 0)  :  qRed(origImg.pixel(x, y));
-					thrImage.setPixel(x, y, qRgb(gray, gray, gray));
-				}
-			}
-			break;
-		case 24:
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int pixel = thrImage.pixel(x, y);
-					int gray = 0;
-					switch (thrChannel) {
-						case channel_gray:
-							gray =  (thrEnabled) ? ((thrValue <= qGray(pixel) && qGray(pixel) <= thrValueUpper) ? 255 : 0) : qGray(pixel);
-							break;
-						case channel_red:
-							gray =  (thrEnabled) ? ((thrValue <= qRed(pixel) && qRed(pixel) <= thrValueUpper) ? 255 : 0) : qRed(pixel);
-							break;
-						case channel_blue:
-							gray =  (thrEnabled) ? ((thrValue <= qBlue(pixel) && qBlue(pixel) <= thrValueUpper) ? 255 : 0) : qBlue(pixel);
-							break;
-						case channel_green:
-							gray =  (thrEnabled) ? ((thrValue <= qGreen(pixel) && qGreen(pixel) <= thrValueUpper) ? 255 : 0) : qGreen(pixel);
-							break;
-					}
-					thrImage.setPixel(x, y, qRgb(gray, gray, gray));
-				}
-			}
-			break;
-		case 32:
-			for (int y = 0; y < thrImage.height(); y++) {
-				for (int x = 0; x < thrImage.width(); x++) {
-					int pixel = thrImage.pixel(x, y);
-					int gray = 0;
-					switch (thrChannel) {
-						case channel_gray:
-							gray =  (thrEnabled) ? ((thrValue <= qGray(pixel) && qGray(pixel) <= thrValueUpper) ? 255 : 0) : qGray(pixel);
-							break;
-						case channel_red:
-							gray =  (thrEnabled) ? ((thrValue <= qRed(pixel) && qRed(pixel) <= thrValueUpper) ? 255 : 0) : qRed(pixel);
-							break;
-						case channel_blue:
-							gray =  (thrEnabled) ? ((thrValue <= qBlue(pixel) && qBlue(pixel) <= thrValueUpper) ? 255 : 0) : qBlue(pixel);
-							break;
-						case channel_green:
-							gray =  (thrEnabled) ? ((thrValue <= qGreen(pixel) && qGreen(pixel) <= thrValueUpper) ? 255 : 0) : qGreen(pixel);
-							break;
-					}
-					int alpha = qAlpha(pixel);
-					thrImage.setPixel(x, y, qRgba(gray, gray, gray, alpha));
-				}
+	for (int ty = levelRect.top() / PREVIEW_TILE_SIZE; ty <= levelRect.bottom() / PREVIEW_TILE_SIZE; ty++) {
+		for (int tx = levelRect.left() / PREVIEW_TILE_SIZE; tx <= levelRect.right() / PREVIEW_TILE_SIZE; tx++) {
+
+			QRect tileRect = QRect(tx * PREVIEW_TILE_SIZE, ty * PREVIEW_TILE_SIZE, PREVIEW_TILE_SIZE, PREVIEW_TILE_SIZE).intersected(levelImg.rect());
+			QPair<quint64, quint64> key(paramKey, ((quint64)ty << 32) | (quint64)tx);
+
+			QImage* tile = tileCache.object(key);
+			if (!tile) {
+				QImage cTile = levelColor ? levelColor->region(tileRect) : QImage();
+				tile = new QImage(thresholdRegion(levelImg.copy(tileRect), cTile, thrEnabled, output_rgb));
+				tileCache.insert(key, tile, tile->byteCount());
 			}
-			break;
+
+			QRectF target(tileRect.x() * fx, tileRect.y() * fy, tileRect.width() * fx, tileRect.height() * fy);
+			painter.drawImage(target, *tile);
+		}
 	}
+}
 
-	if (origImg.depth() == 8) {
+/**
+* Returns the original image downsampled by 2^level.
+**/
+QImage DkThresholdViewPort::previewLevel(int level) {
 
-		QImage outImage = QImage(origImg.size(), QImage::Format_RGB32);
+	if (previewPyramid.isEmpty())
+		previewPyramid.append(origImg);
 
-		QPainter painter(&outImage);
+	while (previewPyramid.size() <= level) {
+		const QImage& last = previewPyramid.last();
+		previewPyramid.append(last.scaled(qMax(last.width()/2, 1), qMax(last.height()/2, 1), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+	}
 
-		painter.drawImage(thrImage.rect(), thrImage);
+	return previewPyramid[level];
+}
 
-		painter.end();
+/**
+* Returns the preview level converted to HSV | Lab (level 0 is the full resolution image).
+* The bands are converted lazily by the workers that need them and the conversion is cached,
+* so changing the bands does not convert again.
+**/
+QSharedPointer<DkColorSpaceCache> DkThresholdViewPort::colorLevel(int level) {
 
-		return outImage;
-	}
+	while (colorPyramid.size() <= level)
+		colorPyramid.append(QSharedPointer<DkColorSpaceCache>(new DkColorSpaceCache(previewLevel(colorPyramid.size()), thrChannel)));
+
+	return colorPyramid[level];
+}
+
+/**
+* Thresholds an image with the current parameters.
+* @param img the (RGB) image
+* @param cImg img converted to HSV | Lab, only needed for color space thresholds
+* @param thrEnabled if false, the selected channel is returned
+* @param outputFormat output_rgb | output_mono
+**/
+QImage DkThresholdViewPort::thresholdRegion(const QImage& img, const QImage& cImg, bool thrEnabled, int outputFormat) {
 
-	QImage outImage = QImage(origImg);
-	QPainter painter(&outImage);
+	if (DkThresholdUtils::isColorSpace(thrChannel))
+		return DkThresholdUtils::thresholdBands(cImg, thrChannel, thrBandLower, thrBandUpper, thrComponent, thrEnabled, outputFormat);
 
-	painter.drawImage(thrImage.rect(), thrImage);
+	// 8 bit images have no color channels
+	int channel = (img.depth() == 8) ? channel_gray : thrChannel;
 
-	painter.end();
-			
-	return outImage;
+	return DkThresholdUtils::thresholdImage(img, channel, thrValue, thrValueUpper, thrEnabled, outputFormat);
 }
 
-void DkThresholdViewPort::setThrValue(int val) {
+QImage DkThresholdViewPort::getOriginalImage() {
+	
+	return origImg;
+}
+
+void DkThresholdViewPort::loadOriginalImage() {
 
-	this->thrValue = val;
-	if (parent()) {
+	if(parent() && !origImgSet) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
+		if (viewport) {
+			origImg = viewport->getImage();
+			origImgSet = true;
+			previewPyramid.clear();
+			colorPyramid.clear();
+			tileCache.clear();
+		}
 	}
-	this->repaint();
 }
 
-void DkThresholdViewPort::setThrValueUpper(int val) {
+QImage DkThresholdViewPort::getThresholdedImage(bool thrEnabled) {
+
+	loadOriginalImage();
+
+	if (DkThresholdUtils::isColorSpace(thrChannel))
+		return DkThresholdUtils::thresholdColorSpace(*colorLevel(0), thrBandLower, thrBandUpper, thrComponent, thrEnabled, thrOutputFormat);
+
+	return thresholdRegion(origImg, QImage(), thrEnabled, thrOutputFormat);
+}
 
-	this->thrValueUpper = val;
-	if (parent()) {
+/**
+* Either repaints the visible tiles or (if the tiled preview is disabled)
+* pushes the full resolution result to the viewport.
+**/
+void DkThresholdViewPort::updatePreview() {
+
+	if (!tiledPreview && parent()) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
 	}
 	this->repaint();
 }
 
+/**
+* Sets the lower threshold - of the current HSV | Lab component if a color space is selected.
+**/
+void DkThresholdViewPort::setThrValue(int val) {
+
+	if (DkThresholdUtils::isColorSpace(thrChannel))
+		thrBandLower[thrComponent] = val;
+	else
+		this->thrValue = val;
+	updatePreview();
+}
+
+void DkThresholdViewPort::setThrValueUpper(int val) {
+
+	if (DkThresholdUtils::isColorSpace(thrChannel))
+		thrBandUpper[thrComponent] = val;
+	else
+		this->thrValueUpper = val;
+	updatePreview();
+}
+
 void DkThresholdViewPort::setThrEnabled(bool enabled) {
 
 	this->thrEnabled = enabled;
-	if (parent()) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
-	}
-	this->repaint();
+	updatePreview();
+}
+
+void DkThresholdViewPort::setThrOutputFormat(int format) {
+
+	this->thrOutputFormat = format;
+	updatePreview();
 }
 
+/**
+* Selects the channel. The toolbar shows the bands of HSV | Lab, so the gray/RGB range is restored when switching back.
+**/
 void DkThresholdViewPort::setThrChannel(int val) {
 
-	this->thrChannel = val;
-	if (parent()) {
-		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
-		if (viewport) viewport->setImage(getThresholdedImage(this->thrEnabled));
+	bool wasColorSpace = DkThresholdUtils::isColorSpace(thrChannel);
+
+	// the conversion is only valid for its color space
+	if (val != thrChannel)
+		colorPyramid.clear();
+
+	// the bands of HSV and Lab have different meanings
+	if (DkThresholdUtils::isColorSpace(val) && val != thrChannel) {
+		for (int idx = 0; idx < 3; idx++) {
+			thrBandLower[idx] = 0;
+			thrBandUpper[idx] = 255;
+		}
 	}
-	this->repaint();
+
+	this->thrChannel = val;
+
+	if (wasColorSpace && !DkThresholdUtils::isColorSpace(val))
+		thresholdToolbar->setThrRange(thrValue, thrValueUpper);
+
+	updatePreview();
 }
 
-void DkThresholdViewPort::calculateAutoThreshold() {
+/**
+* Selects the HSV | Lab component that is edited by the threshold boxes.
+**/
+void DkThresholdViewPort::setThrComponent(int component) {
 
-	double sumPixel = 0;
+	this->thrComponent = qBound(0, component, 2);
+	thresholdToolbar->setThrRange(thrBandLower[thrComponent], thrBandUpper[thrComponent]);
+	updatePreview();
+}
 
-	if (origImg.depth() == 8) {
-		for (int y = 0; y < origImg.height(); y++) {
-			for (int x = 0; x < origImg.width(); x++) {
-				sumPixel += qRed(origImg.pixel(x, y));
-			}
-		}
+/**
+* Starts the auto threshold (mean value of the current channel) in the background.
+* The image is split into row bands whose histograms are computed in parallel.
+* If a computation is already running, it is canceled.
+**/
+void DkThresholdViewPort::calculateAutoThreshold() {
+
+	if (autoThrWatcher.isRunning()) {
+		autoThrWatcher.cancel();
+		return;
 	}
-	else if(origImg.depth() == 24 || origImg.depth() == 32) {
-		for (int y = 0; y < origImg.height(); y++) {
-			for (int x = 0; x < origImg.width(); x++) {
-				int pixel = origImg.pixel(x, y);
-				switch (thrChannel) {
-					case channel_gray:
-						sumPixel += qGray(origImg.pixel(x, y));
-						break;
-					case channel_red:
-						sumPixel += qRed(origImg.pixel(x, y));
-						break;
-					case channel_blue:
-						sumPixel += qBlue(origImg.pixel(x, y));
-						break;
-					case channel_green:
-						sumPixel += qGreen(origImg.pixel(x, y));
-						break;
-				}
-			}
-		}
+
+	loadOriginalImage();
+
+	QImage img = origImg;
+	int channel = thrChannel;
+
+	if (img.isNull())
+		return;
+
+	// ~1 MPixel per band
+	int bandHeight = qMax(1, (1 << 20) / qMax(1, img.width()));
+
+	// the bands are converted to HSV | Lab by the workers (and cached for the preview and the result)
+	QSharedPointer<DkColorSpaceCache> cache;
+	if (DkThresholdUtils::isColorSpace(thrChannel)) {
+		cache = colorLevel(0);
+		channel = channel_red + thrComponent;	// components are stored as RGB888
+		bandHeight = cache->bandHeight();
 	}
 
-	sumPixel /= (origImg.height() * origImg.width());
+	QVector<int> bands;
+	for (int y = 0; y < img.height(); y += bandHeight)
+		bands.append(y);
+
+	thresholdToolbar->setAutoThrRunning(true);
 
-	thresholdToolbar->setThrValue(qRound(sumPixel));
+	autoThrWatcher.setFuture(QtConcurrent::mappedReduced<QVector<qint64> >(
+		bands,
+		DkBandHistogram(img, channel, bandHeight, cache),
+		DkBandHistogram::add));
+}
+
+void DkThresholdViewPort::autoThresholdFinished() {
+
+	thresholdToolbar->setAutoThrRunning(false);
+
+	if (autoThrWatcher.isCanceled())
+		return;
+
+	QVector<qint64> hist = autoThrWatcher.result();
+	thresholdToolbar->setThrValue(qRound(DkThresholdUtils::histogramMean(hist)));
 }
 
 void DkThresholdViewPort::setPanning(bool checked) {
@@ -399,7 +535,7 @@ void DkThresholdViewPort::applyChangesAndClose() {
 void DkThresholdViewPort::discardChangesAndClose() {
 
 	cancelTriggered = true;
-	if(parent() && origImgSet) {
+	if(parent() && origImgSet && !tiledPreview) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (viewport) viewport->setImage(origImg);
 	}
@@ -412,6 +548,11 @@ bool DkThresholdViewPort::isCanceled() {
 
 void DkThresholdViewPort::setVisible(bool visible) {
 
+	if (!visible && autoThrWatcher.isRunning()) {
+		autoThrWatcher.cancel();
+		autoThrWatcher.waitForFinished();
+	}
+
 	if(parent()) {
 		nmc::DkBaseViewPort* viewport = dynamic_cast<nmc::DkBaseViewPort*>(parent());
 		if (viewport) {
@@ -503,6 +644,8 @@ void DkThresholdToolBar::createLayout() {
 	thrChannels.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Red"));
 	thrChannels.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Green"));
 	thrChannels.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Blue"));
+	thrChannels.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "HSV"));
+	thrChannels.append(QT_TRANSLATE_NOOP("nmc::DkThresholdToolBar", "Lab"));
 
 	thrChannelBox = new QComboBox(this);
 	thrChannelBoxContents = new QListWidget(thrChannelBox);
@@ -515,6 +658,12 @@ void DkThresholdToolBar::createLayout() {
 	thrChannelBox->setToolTip(tr("Thresholding channel"));
 	thrChannelBox->setStatusTip(thrChannelBox->toolTip());
 
+	//HSV | Lab component
+	thrComponentBox = new QComboBox(this);
+	thrComponentBox->setObjectName("thrComponentBox");
+	thrComponentBox->setToolTip(tr("Component whose band is edited (all components are scaled to [0 255])"));
+	thrComponentBox->setStatusTip(thrComponentBox->toolTip());
+
 	//threshold value
 	thrValBox = new QSpinBox(this);
 	thrValBox->setObjectName("thrValBox");
@@ -555,6 +704,10 @@ void DkThresholdToolBar::createLayout() {
 	autoThrButton->setToolTip(tr("Automatic threshold calculation"));
 	autoThrButton->setStatusTip(autoThrButton->toolTip());
 
+	autoThrProgress = new QProgressBar(this);
+	autoThrProgress->setMaximumWidth(100);
+	autoThrProgress->setTextVisible(false);
+
 	//display original image
 	thrEnableBox = new QCheckBox(tr("Show original"), this);
 	thrEnableBox->setObjectName("thrEnableBox");
@@ -562,22 +715,34 @@ void DkThresholdToolBar::createLayout() {
 	thrEnableBox->setToolTip(tr("Display original image"));
 	thrEnableBox->setStatusTip(thrEnableBox->toolTip());
 
+	//1 bit output
+	thrMonoBox = new QCheckBox(tr("1 bit"), this);
+	thrMonoBox->setObjectName("thrMonoBox");
+	thrMonoBox->setCheckState(Qt::Unchecked);
+	thrMonoBox->setToolTip(tr("Create a packed black & white image (1 bit per pixel)"));
+	thrMonoBox->setStatusTip(thrMonoBox->toolTip());
+
 	addAction(applyAction);
 	addAction(cancelAction);
 	addSeparator();
 	addAction(panAction);
 	addSeparator();
 	addWidget(thrChannelBox);
+	thrComponentAction = addWidget(thrComponentBox);
+	thrComponentAction->setVisible(false);
 	addWidget(thrValBox);
 	addWidget(thrValSlider);
 	addWidget(thrValUpperBox);
 	addWidget(autoThrButton);
+	autoThrProgressAction = addWidget(autoThrProgress);
+	autoThrProgressAction->setVisible(false);
 	addWidget(thrEnableBox);
+	addWidget(thrMonoBox);
 }
 
 void DkThresholdToolBar::disableColorChannels() {
 
-	for (int index = 1; index <= 3; index++) {
+	for (int index = 1; index < channel_end; index++) {
 		QListWidgetItem *item = thrChannelBoxContents->item(index);
 		item->setFlags(item->flags() & ~Qt::ItemIsEnabled);
 	}
@@ -615,6 +780,31 @@ void DkThresholdToolBar::on_thrValBox_valueChanged(int val) {
 void DkThresholdToolBar::on_thrChannelBox_currentIndexChanged(int val) {
 
 	emit thrChannelSignal(val);
+
+	QStringList components;
+	if (val == channel_hsv)
+		components << tr("Hue") << tr("Saturation") << tr("Value");
+	else if (val == channel_lab)
+		components << tr("L") << tr("a") << tr("b");
+
+	thrComponentBox->blockSignals(true);
+	thrComponentBox->clear();
+	thrComponentBox->addItems(components);
+	thrComponentBox->blockSignals(false);
+	thrComponentAction->setVisible(!components.empty());
+
+	if (!components.empty())
+		emit thrComponentSignal(0);
+
+	setBoxMinimumValue(thrValBox->value());
+}
+
+void DkThresholdToolBar::on_thrComponentBox_currentIndexChanged(int val) {
+
+	if (val >= 0)
+		emit thrComponentSignal(val);
+
+	setBoxMinimumValue(thrValBox->value());
 }
 
 void DkThresholdToolBar::on_thrValUpperBox_valueChanged(int val) {
@@ -632,9 +822,41 @@ void DkThresholdToolBar::setThrValue(int val) {
 	thrValBox->setValue(val);
 }
 
+/**
+* Shows the progress bar and turns the auto button into a cancel button while the auto threshold is computed.
+**/
+void DkThresholdToolBar::setAutoThrRunning(bool running) {
+
+	autoThrButton->setText(running ? tr("Cancel") : tr("Auto"));
+	autoThrButton->setToolTip(running ? tr("Cancel the threshold calculation") : tr("Automatic threshold calculation"));
+	autoThrButton->setStatusTip(autoThrButton->toolTip());
+	autoThrProgress->setValue(autoThrProgress->minimum());
+	autoThrProgressAction->setVisible(running);
+}
+
+void DkThresholdToolBar::setAutoThrProgressRange(int minimum, int maximum) {
+
+	autoThrProgress->setRange(minimum, maximum);
+}
+
+void DkThresholdToolBar::setAutoThrProgress(int val) {
+
+	autoThrProgress->setValue(val);
+}
+
+void DkThresholdToolBar::setThrRange(int lower, int upper) {
+
+	thrValBox->setValue(lower);
+	thrValUpperBox->setValue(upper);
+}
+
+/**
+* Keeps the upper threshold above the lower one - except for the hue which may wrap around.
+**/
 void DkThresholdToolBar::setBoxMinimumValue(int val) {
 
-	thrValUpperBox->setMinimum(val);
+	bool hue = thrChannelBox->currentIndex() == channel_hsv && thrComponentBox->currentIndex() == 0;
+	thrValUpperBox->setMinimum(hue ? 0 : val);
 }
 
 void DkThresholdToolBar::on_thrEnableBox_stateChanged(int val) {
@@ -646,4 +868,9 @@ void DkThresholdToolBar::on_thrEnableBox_stateChanged(int val) {
 	emit thrEnabledSignal(enabled);
 }
 
+void DkThresholdToolBar::on_thrMonoBox_stateChanged(int val) {
+
+	emit thrOutputFormatSignal((val == Qt::Checked) ? output_mono : output_rgb);
+}
+
 };
@@ -45,6 +45,9 @@
 #include <QSlider>
 #include <QPushButton>
 #include <QMouseEvent>
+#include <QCache>
+#include <QProgressBar>
+#include <QFutureWatcher>
 
 #include "DkPluginInterface.h"
 #include "DkSettings.h"
@@ -52,6 +55,8 @@
 #include "DkBaseViewPort.h"
 #include "DkImageStorage.h"
 
+#include "DkThresholdUtils.h"
+
 namespace nmp {
 
 class DkThresholdViewPort;
@@ -102,23 +107,23 @@ public slots:
 	void calculateAutoThreshold();
 	void setThrChannel(int val);
 	void setThrEnabled(bool enabled);
+	void setThrOutputFormat(int format);
+	void setThrComponent(int component);
+	void autoThresholdFinished();
 
 protected:
 
-	enum {
-		channel_gray = 0,
-		channel_red,
-		channel_green,
-		channel_blue,
-
-		channel_end,
-	};
-
 	void mouseMoveEvent(QMouseEvent *event);
 	void mousePressEvent(QMouseEvent *event);
 	void mouseReleaseEvent(QMouseEvent*event);
 	void paintEvent(QPaintEvent *event);
 	virtual void init();
+	void loadOriginalImage();
+	void updatePreview();
+	void drawPreviewTiles(QPainter& painter);
+	QImage previewLevel(int level);
+	QSharedPointer<DkColorSpaceCache> colorLevel(int level);
+	QImage thresholdRegion(const QImage& img, const QImage& cImg, bool thrEnabled, int outputFormat);
 
 	bool cancelTriggered;
 	bool panning;
@@ -128,8 +133,21 @@ protected:
 	int thrValue;
 	int thrValueUpper;
 	bool thrEnabled;
+	int thrOutputFormat;
+	int thrComponent;
+	int thrBandLower[3];	// HSV | Lab bands
+	int thrBandUpper[3];
 	QImage origImg;
 	bool origImgSet;
+
+	// tiled preview: only visible tiles are thresholded, the base viewport keeps the original image
+	bool tiledPreview;
+	QVector<QImage> previewPyramid;
+	QVector<QSharedPointer<DkColorSpaceCache> > colorPyramid;	// previewPyramid converted to HSV | Lab - dropped if the image or channel changes
+	QCache<QPair<quint64, quint64>, QImage> tileCache;
+
+	// auto threshold: band histograms are computed in parallel
+	QFutureWatcher<QVector<qint64> > autoThrWatcher;
 };
 
 
@@ -152,6 +170,8 @@ public:
 
 	void disableColorChannels();
 	void setThrValue(int val);
+	void setThrRange(int lower, int upper);
+	void setAutoThrRunning(bool running);
 
 
 public slots:
@@ -161,10 +181,14 @@ public slots:
 	void on_thrValBox_valueChanged(int val);
 	void on_thrValUpperBox_valueChanged(int val);
 	void on_thrChannelBox_currentIndexChanged(int val);
+	void on_thrComponentBox_currentIndexChanged(int val);
 	void on_thrEnableBox_stateChanged(int val);
+	void on_thrMonoBox_stateChanged(int val);
 	void on_autoThrButton_clicked();
 	virtual void setVisible(bool visible);
 	void setBoxMinimumValue(int val);
+	void setAutoThrProgressRange(int minimum, int maximum);
+	void setAutoThrProgress(int val);
 
 signals:
 	void applySignal();
@@ -173,7 +197,9 @@ signals:
 	void thrValUpperSignal(int val);
 	void calculateAutoThresholdSignal();
 	void thrChannelSignal(int val);
+	void thrComponentSignal(int component);
 	void thrEnabledSignal(bool enabled);
+	void thrOutputFormatSignal(int format);
 	void panSignal(bool checked);
 
 protected:
@@ -184,9 +210,14 @@ protected:
 	QSpinBox* thrValUpperBox;
 	QSlider* thrValSlider;
 	QComboBox* thrChannelBox;
+	QComboBox* thrComponentBox;
+	QAction* thrComponentAction;
 	QCheckBox* thrEnableBox;
+	QCheckBox* thrMonoBox;
 	QListWidget* thrChannelBoxContents;
 	QPushButton* autoThrButton;
+	QProgressBar* autoThrProgress;
+	QAction* autoThrProgressAction;
 
 	QAction* panAction;
 	QVector<QIcon> icons;		// needed for colorizing
@@ -0,0 +1,676 @@
+/*******************************************************************************************************
+ DkThresholdUtils.cpp
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#include "DkThresholdUtils.h"
+
+#include <QColor>
+#include <QDebug>
+#include <QAtomicInt>
+#include <QMutexLocker>
+#include <QtConcurrentMap>
+
+#include <cstring>
+
+#ifdef DK_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef WITH_OPENCV
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#endif
+
+#define DK_THR_BAND_PIXELS (1 << 20)	// pixels per parallel row band of the color space threshold
+
+namespace nmp {
+
+/**
+* @return true if the row kernels can read format directly (Indexed8 | Grayscale8 | RGB888 | RGB32 | ARGB32)
+**/
+bool DkThresholdUtils::isSupportedFormat(QImage::Format format) {
+
+	switch (format) {
+	case QImage::Format_Indexed8:
+	case QImage::Format_Grayscale8:
+	case QImage::Format_RGB888:
+	case QImage::Format_RGB32:
+	case QImage::Format_ARGB32:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+* Converts all formats which are not handled by the row kernels to (A)RGB32.
+* @param img the input image
+* @return the image in Indexed8 | Grayscale8 | RGB888 | RGB32 | ARGB32
+**/
+QImage DkThresholdUtils::toSupportedFormat(const QImage& img) {
+
+	if (img.isNull() || isSupportedFormat(img.format()))
+		return img;
+
+	return img.convertToFormat(img.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+}
+
+/**
+* Indexed images are thresholded on the red value of their color table.
+* @param img the input image
+* @return a 256 entry lookup table for Indexed8 images, an empty vector otherwise
+**/
+QVector<uchar> DkThresholdUtils::channelLut(const QImage& img) {
+
+	QVector<uchar> lut;
+
+	if (img.format() != QImage::Format_Indexed8)
+		return lut;
+
+	QVector<QRgb> colors = img.colorTable();
+	lut.fill(0, 256);
+
+	for (int idx = 0; idx < colors.size() && idx < lut.size(); idx++)
+		lut[idx] = (uchar)qRed(colors[idx]);
+
+	return lut;
+}
+
+/**
+* Extracts the selected channel of one image row.
+* @param img the image (see toSupportedFormat)
+* @param row the row index
+* @param channel one of channel_gray | channel_red | channel_green | channel_blue
+* @param lut the lookup table for Indexed8 images (see channelLut)
+* @param dst a buffer with at least img.width() elements
+**/
+void DkThresholdUtils::channelRow(const QImage& img, int row, int channel, const QVector<uchar>& lut, uchar* dst) {
+
+	const uchar* line = img.constScanLine(row);
+	int width = img.width();
+
+	switch (img.format()) {
+	case QImage::Format_Indexed8:
+		for (int x = 0; x < width; x++)
+			dst[x] = lut[line[x]];
+		break;
+	case QImage::Format_Grayscale8:
+		memcpy(dst, line, width);
+		break;
+	case QImage::Format_RGB888:
+		for (int x = 0; x < width; x++, line += 3) {
+			switch (channel) {
+			case channel_red:	dst[x] = line[0]; break;
+			case channel_green:	dst[x] = line[1]; break;
+			case channel_blue:	dst[x] = line[2]; break;
+			default:			dst[x] = (uchar)qGray(line[0], line[1], line[2]); break;
+			}
+		}
+		break;
+	default: {
+		const QRgb* pixel = (const QRgb*)line;
+		for (int x = 0; x < width; x++) {
+			switch (channel) {
+			case channel_red:	dst[x] = (uchar)qRed(pixel[x]); break;
+			case channel_green:	dst[x] = (uchar)qGreen(pixel[x]); break;
+			case channel_blue:	dst[x] = (uchar)qBlue(pixel[x]); break;
+			default:			dst[x] = (uchar)qGray(pixel[x]); break;
+			}
+		}
+		break;
+	}
+	}
+}
+
+/**
+* Sets all values within [lower upper] to 255 and all others to 0.
+* @param src the channel values
+* @param dst the thresholded values (may be src)
+* @param width the number of elements
+**/
+void DkThresholdUtils::thresholdRow(const uchar* src, uchar* dst, int width, int lower, int upper) {
+
+	int x = 0;
+
+#ifdef DK_SSE2
+	// lower <= v <= upper  <=>  max(v, lower) == v && min(v, upper) == v (unsigned compares are not available in SSE2)
+	const __m128i lo = _mm_set1_epi8((char)qBound(0, lower, 255));
+	const __m128i hi = _mm_set1_epi8((char)qBound(0, upper, 255));
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v), _mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+		_mm_storeu_si128((__m128i*)(dst + x), in);
+	}
+#endif
+
+	for (; x < width; x++)
+		dst[x] = (lower <= src[x] && src[x] <= upper) ? 255 : 0;
+}
+
+/**
+* Thresholds one row and packs the result to 1 bit per pixel.
+* The bit order is least significant bit first which is what QImage::Format_MonoLSB
+* expects and what _mm_movemask_epi8 delivers - so no bit reversal is needed.
+* @param src the channel values
+* @param dst the packed scanline with at least (width+7)/8 bytes
+* @param width the number of pixels
+**/
+void DkThresholdUtils::thresholdPackRow(const uchar* src, uchar* dst, int width, int lower, int upper) {
+
+	int x = 0;
+
+#ifdef DK_SSE2
+	const __m128i lo = _mm_set1_epi8((char)qBound(0, lower, 255));
+	const __m128i hi = _mm_set1_epi8((char)qBound(0, upper, 255));
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v), _mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+		int bits = _mm_movemask_epi8(in);
+
+		dst[x >> 3] = (uchar)(bits & 0xff);
+		dst[(x >> 3) + 1] = (uchar)(bits >> 8);
+	}
+#endif
+
+	// x is a multiple of 8 here
+	memset(dst + (x >> 3), 0, (width + 7) / 8 - (x >> 3));
+
+	for (; x < width; x++) {
+		if (lower <= src[x] && src[x] <= upper)
+			dst[x >> 3] |= (uchar)(1 << (x & 7));
+	}
+}
+
+/**
+* Writes gray values to one row of dst - the alpha channel of src is kept.
+* @param src the input image (see toSupportedFormat)
+* @param row the row index
+* @param gray the gray values
+* @param dst the output image which is RGB888 | RGB32 | ARGB32
+**/
+void DkThresholdUtils::grayRow(const QImage& src, int row, const uchar* gray, QImage& dst) {
+
+	uchar* line = dst.scanLine(row);
+	int width = dst.width();
+
+	if (dst.format() == QImage::Format_RGB888) {
+		for (int x = 0; x < width; x++, line += 3)
+			line[0] = line[1] = line[2] = gray[x];
+	}
+	else if (dst.format() == QImage::Format_ARGB32) {
+		const QRgb* srcPixel = (const QRgb*)src.constScanLine(row);
+		QRgb* pixel = (QRgb*)line;
+		for (int x = 0; x < width; x++)
+			pixel[x] = qRgba(gray[x], gray[x], gray[x], qAlpha(srcPixel[x]));
+	}
+	else {
+		QRgb* pixel = (QRgb*)line;
+		for (int x = 0; x < width; x++)
+			pixel[x] = qRgb(gray[x], gray[x], gray[x]);
+	}
+}
+
+/**
+* Thresholds an image.
+* @param img the input image
+* @param channel the channel that is thresholded
+* @param lower the lower threshold
+* @param upper the upper threshold
+* @param thrEnabled if false, the selected channel is returned as gray image
+* @param outputFormat output_rgb returns gray values in the input's format (8 bit images are returned as RGB32),
+* output_mono returns a packed 1 bit image which needs 1/32 of the memory (the alpha channel is dropped).
+* @return the thresholded image
+**/
+QImage DkThresholdUtils::thresholdImage(const QImage& img, int channel, int lower, int upper, bool thrEnabled, int outputFormat) {
+
+	QImage src = toSupportedFormat(img);
+
+	if (src.isNull())
+		return src;
+
+	bool mono = thrEnabled && outputFormat == output_mono;
+
+	QImage dst = createOutput(src, mono);
+	if (dst.isNull())
+		return dst;
+
+	QVector<uchar> lut = channelLut(src);
+	QVector<uchar> chRow(src.width());
+
+	for (int y = 0; y < src.height(); y++) {
+
+		channelRow(src, y, channel, lut, chRow.data());
+
+		if (mono) {
+			thresholdPackRow(chRow.data(), dst.scanLine(y), src.width(), lower, upper);
+		}
+		else {
+			if (thrEnabled)
+				thresholdRow(chRow.data(), chRow.data(), src.width(), lower, upper);
+			grayRow(src, y, chRow.constData(), dst);
+		}
+	}
+
+	return dst;
+}
+
+/**
+* Allocates the output image of the threshold functions.
+* @param src the input image
+* @param mono if true, a 1 bit image is created
+* @return MonoLSB | RGB32 (8 bit input) | the format of src
+**/
+QImage DkThresholdUtils::createOutput(const QImage& src, bool mono) {
+
+	QImage dst;
+	if (mono) {
+		dst = QImage(src.size(), QImage::Format_MonoLSB);
+		QVector<QRgb> colors;
+		colors << qRgb(0, 0, 0) << qRgb(255, 255, 255);
+		dst.setColorTable(colors);
+	}
+	else if (src.depth() == 8)
+		dst = QImage(src.size(), QImage::Format_RGB32);
+	else
+		dst = QImage(src.size(), src.format());
+
+	if (dst.isNull())
+		return dst;
+
+	dst.setDotsPerMeterX(src.dotsPerMeterX());
+	dst.setDotsPerMeterY(src.dotsPerMeterY());
+
+	return dst;
+}
+
+/**
+* Converts an image to HSV or Lab.
+* The conversion is done by OpenCV which uses vectorized and multi-threaded kernels.
+* Large images should be converted in bands (see DkColorSpaceCache).
+* @param img the input image
+* @param channel channel_hsv (H is scaled to [0 255]) | channel_lab (L is scaled to [0 255], a and b are shifted by 128)
+* @return a Format_RGB888 image that holds the three components (e.g. H,S,V) instead of R,G,B
+**/
+QImage DkThresholdUtils::convertColorSpace(const QImage& img, int channel) {
+
+	if (img.isNull() || !isColorSpace(channel))
+		return QImage();
+
+	QImage rgb = img.convertToFormat(QImage::Format_RGB888);
+	QImage dst(rgb.size(), QImage::Format_RGB888);
+
+	if (dst.isNull())
+		return dst;
+
+#ifdef WITH_OPENCV
+	// wrap the scanlines - cvtColor writes directly into dst since size and type already match
+	cv::Mat srcMat(rgb.height(), rgb.width(), CV_8UC3, (void*)rgb.constBits(), rgb.bytesPerLine());
+	cv::Mat dstMat(dst.height(), dst.width(), CV_8UC3, dst.bits(), dst.bytesPerLine());
+	cv::cvtColor(srcMat, dstMat, (channel == channel_hsv) ? cv::COLOR_RGB2HSV_FULL : cv::COLOR_RGB2Lab);
+#else
+	qWarning() << "color space thresholds need OpenCV";
+	return QImage();
+#endif
+
+	dst.setDotsPerMeterX(img.dotsPerMeterX());
+	dst.setDotsPerMeterY(img.dotsPerMeterY());
+
+	return dst;
+}
+
+/**
+* Thresholds an image with one band per component - a pixel is set if all its components are within their band.
+* The hue is circular: if its lower threshold is larger than the upper one, the band wraps around 0 (e.g. red).
+* @param cImg the converted image (see convertColorSpace)
+* @param channel channel_hsv | channel_lab
+* @param lower the lower thresholds of the three components
+* @param upper the upper thresholds of the three components
+* @param component the component that is shown if thrEnabled is false
+* @param thrEnabled if false, the selected component is returned as gray image
+* @param outputFormat output_rgb | output_mono
+* @return the thresholded image
+**/
+QImage DkThresholdUtils::thresholdBands(const QImage& cImg, int channel, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat) {
+
+	if (cImg.isNull() || cImg.format() != QImage::Format_RGB888)
+		return QImage();
+
+	bool mono = thrEnabled && outputFormat == output_mono;
+
+	QImage dst = createOutput(cImg, mono);
+	if (dst.isNull())
+		return dst;
+
+	int width = cImg.width();
+	QVector<uchar> planes(width * 3);
+	uchar* c[3] = {planes.data(), planes.data() + width, planes.data() + 2 * width};
+
+	for (int y = 0; y < cImg.height(); y++) {
+
+		const uchar* line = cImg.constScanLine(y);
+		for (int x = 0; x < width; x++, line += 3) {
+			c[0][x] = line[0];
+			c[1][x] = line[1];
+			c[2][x] = line[2];
+		}
+
+		if (!thrEnabled) {
+			grayRow(cImg, y, c[qBound(0, component, 2)], dst);
+			continue;
+		}
+
+		for (int idx = 0; idx < 3; idx++) {
+
+			// wrapped hue: h >= lower || h <= upper  <=>  !(upper < h < lower)
+			if (idx == 0 && channel == channel_hsv && lower[0] > upper[0]) {
+				thresholdRow(c[0], c[0], width, upper[0] + 1, lower[0] - 1);
+				for (int x = 0; x < width; x++)
+					c[0][x] ^= 255;
+			}
+			else
+				thresholdRow(c[idx], c[idx], width, lower[idx], upper[idx]);
+		}
+
+		for (int x = 0; x < width; x++)
+			c[0][x] &= c[1][x] & c[2][x];
+
+		if (mono)
+			thresholdPackRow(c[0], dst.scanLine(y), width, 255, 255);
+		else
+			grayRow(cImg, y, c[0], dst);
+	}
+
+	return dst;
+}
+
+/**
+* Converts an image to HSV | Lab and thresholds it (see thresholdBands).
+* The conversion is not kept - use a DkColorSpaceCache if the image is thresholded several times.
+* @param img the input image
+* @param channel channel_hsv | channel_lab
+* @param lower the lower thresholds of the three components
+* @param upper the upper thresholds of the three components
+* @param component the component that is shown if thrEnabled is false
+* @param thrEnabled if false, the selected component is returned as gray image
+* @param outputFormat output_rgb | output_mono
+* @return the thresholded image
+**/
+QImage DkThresholdUtils::thresholdColorSpace(const QImage& img, int channel, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat) {
+
+	if (img.isNull() || !isColorSpace(channel))
+		return QImage();
+
+	DkColorSpaceCache cache(img, channel);
+
+	return thresholdColorSpace(cache, lower, upper, component, thrEnabled, outputFormat);
+}
+
+/**
+* Thresholds the image of a color space cache (see thresholdBands).
+* The bands are thresholded in parallel - bands that are not cached yet are converted by the workers,
+* so the full resolution image is never converted at once.
+* @param cache the converted image
+* @param lower the lower thresholds of the three components
+* @param upper the upper thresholds of the three components
+* @param component the component that is shown if thrEnabled is false
+* @param thrEnabled if false, the selected component is returned as gray image
+* @param outputFormat output_rgb | output_mono
+* @return the thresholded image
+**/
+QImage DkThresholdUtils::thresholdColorSpace(DkColorSpaceCache& cache, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat) {
+
+	QImage img = cache.image();
+	int channel = cache.channel();
+
+	if (img.isNull() || !isColorSpace(channel))
+		return QImage();
+
+	bool mono = thrEnabled && outputFormat == output_mono;
+
+	// thresholdBands returns the format of the converted image (RGB888) or MonoLSB
+	QImage dst = mono ? createOutput(img, true) : QImage(img.size(), QImage::Format_RGB888);
+	if (dst.isNull())
+		return dst;
+
+	dst.setDotsPerMeterX(img.dotsPerMeterX());
+	dst.setDotsPerMeterY(img.dotsPerMeterY());
+
+	QVector<int> bands;
+	for (int idx = 0; idx < cache.numBands(); idx++)
+		bands.append(idx);
+
+	// get the pointer before the workers start so that dst is not detached
+	uchar* dstBits = dst.bits();
+	int dstBpl = dst.bytesPerLine();
+	QAtomicInt failed(0);
+
+	QtConcurrent::blockingMap(bands, [&](int idx) {
+
+		QImage band = thresholdBands(cache.band(idx), channel, lower, upper, component, thrEnabled, outputFormat);
+
+		if (band.isNull() || band.bytesPerLine() != dstBpl) {
+			failed.store(1);
+			return;
+		}
+
+		qint64 firstRow = (qint64)idx * cache.bandHeight();
+		for (int y = 0; y < band.height(); y++)
+			memcpy(dstBits + (firstRow + y) * dstBpl, band.constScanLine(y), dstBpl);
+	});
+
+	if (failed.load())
+		return QImage();
+
+	return dst;
+}
+
+/**
+* Computes the histogram of a row band - this is thread-safe so bands can be processed in parallel.
+* @param img the input image
+* @param channel the channel (use channel_red + idx to get component idx of a converted HSV | Lab image)
+* @param firstRow the first row of the band
+* @param numRows the number of rows
+* @return a histogram with 256 bins
+**/
+QVector<qint64> DkThresholdUtils::histogram(const QImage& img, int channel, int firstRow, int numRows) {
+
+	QVector<qint64> hist(256, 0);
+
+	int lastRow = qMin(firstRow + numRows, img.height());
+	if (img.isNull() || firstRow >= lastRow)
+		return hist;
+
+	// just convert the band if the format is not supported
+	QImage src = img;
+	int offset = 0;
+	if (!isSupportedFormat(img.format())) {
+		src = toSupportedFormat(img.copy(0, firstRow, img.width(), lastRow - firstRow));
+		offset = firstRow;
+	}
+
+	QVector<uchar> lut = channelLut(src);
+	QVector<uchar> row(src.width());
+	qint64* h = hist.data();
+
+	for (int y = firstRow; y < lastRow; y++) {
+
+		channelRow(src, y - offset, channel, lut, row.data());
+
+		const uchar* r = row.constData();
+		for (int x = 0; x < src.width(); x++)
+			h[r[x]]++;
+	}
+
+	return hist;
+}
+
+/**
+* @return the mean value of a histogram
+**/
+double DkThresholdUtils::histogramMean(const QVector<qint64>& hist) {
+
+	double sum = 0;
+	qint64 n = 0;
+
+	for (int idx = 0; idx < hist.size(); idx++) {
+		sum += (double)idx * hist[idx];
+		n += hist[idx];
+	}
+
+	return (n > 0) ? sum / n : 0.0;
+}
+
+/**
+* Computes the histogram of the band that starts at firstRow.
+**/
+QVector<qint64> DkBandHistogram::operator()(int firstRow) const {
+
+	if (!cache)
+		return DkThresholdUtils::histogram(img, channel, firstRow, bandHeight);
+
+	QImage cBand = cache->band(firstRow / bandHeight);
+
+	return DkThresholdUtils::histogram(cBand, channel, 0, cBand.height());
+}
+
+/**
+* Reduce function for QtConcurrent::mappedReduced.
+**/
+void DkBandHistogram::add(QVector<qint64>& result, const QVector<qint64>& partial) {
+
+	if (result.isEmpty()) {
+		result = partial;
+		return;
+	}
+
+	for (int idx = 0; idx < result.size() && idx < partial.size(); idx++)
+		result[idx] += partial[idx];
+}
+
+/*-----------------------------------DkColorSpaceCache ---------------------------------------------*/
+
+/**
+* Creates an empty cache - no band is converted yet.
+* @param img the input image
+* @param channel channel_hsv | channel_lab
+**/
+DkColorSpaceCache::DkColorSpaceCache(const QImage& img, int channel) {
+
+	this->img = img;
+	colorSpace = channel;
+	rows = qMax(1, DK_THR_BAND_PIXELS / qMax(1, img.width()));
+
+	if (!img.isNull() && DkThresholdUtils::isColorSpace(channel))
+		bands.resize((img.height() + rows - 1) / rows);
+}
+
+/**
+* Returns the converted band idx and converts it if it is not cached yet.
+* The conversion runs without the lock, so several threads can convert different bands.
+* @param idx the band index
+* @return the band (RGB888 holding the three components)
+**/
+QImage DkColorSpaceCache::band(int idx) {
+
+	if (idx < 0 || idx >= bands.size())
+		return QImage();
+
+	{
+		QMutexLocker locker(&mutex);
+		if (!bands[idx].isNull())
+			return bands[idx];
+	}
+
+	int firstRow = idx * rows;
+	QImage cBand = DkThresholdUtils::convertColorSpace(img.copy(0, firstRow, img.width(), qMin(rows, img.height() - firstRow)), colorSpace);
+
+	QMutexLocker locker(&mutex);
+	bands[idx] = cBand;
+
+	return cBand;
+}
+
+/**
+* Converts all bands between firstRow and lastRow in parallel that are not cached yet.
+* @param firstRow the first row
+* @param lastRow the last row (inclusive)
+**/
+void DkColorSpaceCache::convertRows(int firstRow, int lastRow) {
+
+	QVector<int> missing;
+
+	{
+		QMutexLocker locker(&mutex);
+		for (int idx = qMax(firstRow / rows, 0); idx <= lastRow / rows && idx < bands.size(); idx++) {
+			if (bands[idx].isNull())
+				missing.append(idx);
+		}
+	}
+
+	QtConcurrent::blockingMap(missing, [this](int idx) {
+		band(idx);
+	});
+}
+
+/**
+* Returns a region of the converted image (e.g. a tile of the preview).
+* @param r the region in image coordinates
+* @return the converted region (RGB888)
+**/
+QImage DkColorSpaceCache::region(const QRect& r) {
+
+	QRect cr = r.intersected(img.rect());
+	if (cr.isEmpty() || bands.isEmpty())
+		return QImage();
+
+	convertRows(cr.top(), cr.bottom());
+
+	QImage dst(cr.size(), QImage::Format_RGB888);
+	if (dst.isNull())
+		return dst;
+
+	QImage cBand;
+	int bandIdx = -1;
+
+	for (int y = cr.top(); y <= cr.bottom(); y++) {
+
+		if (y / rows != bandIdx) {
+			bandIdx = y / rows;
+			cBand = band(bandIdx);
+		}
+
+		if (cBand.isNull())
+			return QImage();
+
+		memcpy(dst.scanLine(y - cr.top()), cBand.constScanLine(y - bandIdx * rows) + cr.left() * 3, cr.width() * 3);
+	}
+
+	return dst;
+}
+
+};
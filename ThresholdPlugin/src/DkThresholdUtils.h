@@ -0,0 +1,139 @@
+/*******************************************************************************************************
+ DkThresholdUtils.h
+ Created on:	19.10.2026
+
+ nomacs is a fast and small image viewer with the capability of synchronizing multiple instances
+
+ Copyright (C) 2011-2014 Markus Diem <markus@nomacs.org>
+ Copyright (C) 2011-2014 Stefan Fiel <stefan@nomacs.org>
+ Copyright (C) 2011-2014 Florian Kleber <florian@nomacs.org>
+
+ This file is part of nomacs.
+
+ nomacs is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ nomacs is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ *******************************************************************************************************/
+
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QRect>
+#include <QMutex>
+#include <QSharedPointer>
+
+namespace nmp {
+
+enum {
+	channel_gray = 0,
+	channel_red,
+	channel_green,
+	channel_blue,
+	channel_hsv,		// one band per component
+	channel_lab,
+
+	channel_end,
+};
+
+enum {
+	output_rgb = 0,		// gray values in the input's (8/24/32 bit) format
+	output_mono,		// packed 1 bit (QImage::Format_MonoLSB)
+
+	output_end,
+};
+
+class DkColorSpaceCache;
+
+/**
+* Row based threshold kernels.
+* All functions work on scanlines so that no QImage::pixel() / setPixel() is needed.
+**/
+class DkThresholdUtils {
+
+public:
+	static bool isSupportedFormat(QImage::Format format);
+	static QImage toSupportedFormat(const QImage& img);
+	static QVector<uchar> channelLut(const QImage& img);
+
+	static void channelRow(const QImage& img, int row, int channel, const QVector<uchar>& lut, uchar* dst);
+	static void thresholdRow(const uchar* src, uchar* dst, int width, int lower, int upper);
+	static void thresholdPackRow(const uchar* src, uchar* dst, int width, int lower, int upper);
+	static void grayRow(const QImage& src, int row, const uchar* gray, QImage& dst);
+
+	static QImage thresholdImage(const QImage& img, int channel, int lower, int upper, bool thrEnabled, int outputFormat = output_rgb);
+
+	static bool isColorSpace(int channel) { return channel == channel_hsv || channel == channel_lab; };
+	static QImage convertColorSpace(const QImage& img, int channel);
+	static QImage thresholdBands(const QImage& cImg, int channel, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat = output_rgb);
+	static QImage thresholdColorSpace(const QImage& img, int channel, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat = output_rgb);
+	static QImage thresholdColorSpace(DkColorSpaceCache& cache, const int* lower, const int* upper, int component, bool thrEnabled, int outputFormat = output_rgb);
+
+	static QVector<qint64> histogram(const QImage& img, int channel, int firstRow, int numRows);
+	static double histogramMean(const QVector<qint64>& hist);
+
+protected:
+	static QImage createOutput(const QImage& src, bool mono);
+};
+
+/**
+* An image converted to HSV | Lab in row bands (~1 MPixel each).
+* The bands are converted lazily by the (worker) threads that need them and kept until the cache is dropped,
+* so changing the thresholds does not convert again. This class is thread-safe.
+**/
+class DkColorSpaceCache {
+
+public:
+	DkColorSpaceCache(const QImage& img, int channel);
+
+	QImage image() const { return img; };
+	int channel() const { return colorSpace; };
+	int bandHeight() const { return rows; };
+	int numBands() const { return bands.size(); };
+
+	QImage band(int idx);
+	QImage region(const QRect& r);
+	void convertRows(int firstRow, int lastRow);
+
+protected:
+	QImage img;
+	int colorSpace;
+	int rows;				// rows per band
+	QVector<QImage> bands;	// null until converted
+	QMutex mutex;
+};
+
+/**
+* Map functor for QtConcurrent::mappedReduced - computes the histogram of one row band.
+* If a color space cache is set, the histogram of its band is computed (the band is converted if it is not cached yet).
+**/
+class DkBandHistogram {
+
+public:
+	typedef QVector<qint64> result_type;
+
+	DkBandHistogram(const QImage& img, int channel, int bandHeight, QSharedPointer<DkColorSpaceCache> cache = QSharedPointer<DkColorSpaceCache>()) : 
+		img(img), channel(channel), bandHeight(bandHeight), cache(cache) {};
+
+	QVector<qint64> operator()(int firstRow) const;
+
+	static void add(QVector<qint64>& result, const QVector<qint64>& partial);
+
+protected:
+	QImage img;
+	int channel;		// use channel_red + idx for component idx of a color space
+	int bandHeight;		// must be cache->bandHeight() if a cache is set
+	QSharedPointer<DkColorSpaceCache> cache;
+};
+
+};
@@ -217,3 +217,17 @@ macro(NMC_GENERATE_USER_FILE)
 		endif()
 	endif(MSVC)
 endmacro(NMC_GENERATE_USER_FILE)
+
+# Defines DK_SSE2 if the compiler targets SSE2 (every x64 target, x86 only if it is enabled explicitly)
+macro(NMC_CHECK_SSE2)
+	include(CheckCXXSourceCompiles)
+	CHECK_CXX_SOURCE_COMPILES("
+		#if !defined(__SSE2__) && !defined(_M_X64) && !(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#error SSE2 is not enabled
+		#endif
+		#include <emmintrin.h>
+		int main() { return _mm_cvtsi128_si32(_mm_setzero_si128()); }" NMC_HAVE_SSE2)
+	if(NMC_HAVE_SSE2)
+		add_definitions(-DDK_SSE2)
+	endif()
+endmacro(NMC_CHECK_SSE2)